@@ -0,0 +1,76 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <algorithm>
+
+#include "Utility.h"
+#include "Ray.h"
+
+// Axis-aligned bounding box
+class Aabb {
+    public:
+        Vec3 mMinimum;
+        Vec3 mMaximum;
+
+    public:
+        Aabb() : mMinimum(infinity, infinity, infinity), mMaximum(-infinity, -infinity, -infinity) {}
+        Aabb(const Vec3& a, const Vec3& b) : mMinimum(a), mMaximum(b) {}
+
+        Vec3 min() const { return mMinimum; }
+        Vec3 max() const { return mMaximum; }
+
+        bool IsEmpty() const { return mMinimum.x() > mMaximum.x(); }
+
+        Vec3 Centroid() const { return 0.5 * (mMinimum + mMaximum); }
+
+        void Grow(const Vec3& p) {
+            for (int a = 0; a < 3; a++) {
+                mMinimum[a] = std::min(mMinimum[a], p[a]);
+                mMaximum[a] = std::max(mMaximum[a], p[a]);
+            }
+        }
+
+        void Grow(const Aabb& box) {
+            if (box.IsEmpty()) {
+                return;
+            }
+            Grow(box.mMinimum);
+            Grow(box.mMaximum);
+        }
+
+        double SurfaceArea() const {
+            if (IsEmpty()) {
+                return 0.0;
+            }
+            Vec3 d = mMaximum - mMinimum;
+            return 2.0 * (double(d.x()) * d.y() + double(d.y()) * d.z() + double(d.z()) * d.x());
+        }
+
+        // Slab test, only tells whether the ray crosses the box somewhere in [tMin, tMax]
+        bool Hit(const Ray& r, Real tMin, Real tMax) const {
+            for (int a = 0; a < 3; a++) {
+                Real invD = 1 / r.direction()[a];
+                Real t0 = (mMinimum[a] - r.origin()[a]) * invD;
+                Real t1 = (mMaximum[a] - r.origin()[a]) * invD;
+                if (invD < 0) {
+                    std::swap(t0, t1);
+                }
+
+                tMin = t0 > tMin ? t0 : tMin;
+                tMax = t1 < tMax ? t1 : tMax;
+                if (tMax < tMin) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+};
+
+inline Aabb SurroundingBox(const Aabb& box0, const Aabb& box1) {
+    Aabb box = box0;
+    box.Grow(box1);
+    return box;
+}
+
+#endif //AABB_H
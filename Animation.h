@@ -0,0 +1,237 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Camera.h"
+#include "SceneFile.h"
+#include "SphereBatch.h"
+
+inline Vec3 Lerp(const Vec3& a, const Vec3& b, double t) {
+    return a + Real(t) * (b - a);
+}
+
+inline CameraRecord Lerp(const CameraRecord& a, const CameraRecord& b, double t) {
+    CameraRecord c = a;
+    for (int i = 0; i < 3; i++) {
+        c.lookFrom[i] = a.lookFrom[i] + t * (b.lookFrom[i] - a.lookFrom[i]);
+        c.lookAt[i] = a.lookAt[i] + t * (b.lookAt[i] - a.lookAt[i]);
+        c.vup[i] = a.vup[i] + t * (b.vup[i] - a.vup[i]);
+    }
+    c.verticalFov = a.verticalFov + t * (b.verticalFov - a.verticalFov);
+    c.aperture = a.aperture + t * (b.aperture - a.aperture);
+    c.focusDistance = a.focusDistance + t * (b.focusDistance - a.focusDistance);
+    return c;
+}
+
+// Values at given times, interpolated linearly in between and held before the first key and after the last
+template <typename T>
+class KeyframeTrack {
+    private:
+        std::vector<std::pair<double, T>> mKeys;
+
+    public:
+        bool Empty() const { return mKeys.empty(); }
+
+        // Keys may come in any order, a key at the time of an existing one replaces it
+        void Add(double time, const T& value) {
+            auto it = std::lower_bound(mKeys.begin(), mKeys.end(), time, [](const std::pair<double, T>& key, double t) { return key.first < t; });
+            if (it != mKeys.end() && it->first == time) {
+                it->second = value;
+            }
+            else {
+                mKeys.insert(it, std::make_pair(time, value));
+            }
+        }
+
+        T At(double time) const {
+            if (time <= mKeys.front().first) {
+                return mKeys.front().second;
+            }
+            if (time >= mKeys.back().first) {
+                return mKeys.back().second;
+            }
+            auto next = std::upper_bound(mKeys.begin(), mKeys.end(), time, [](double t, const std::pair<double, T>& key) { return t < key.first; });
+            auto previous = next - 1;
+            return Lerp(previous->second, next->second, (time - previous->first) / (next->first - previous->first));
+        }
+};
+
+// What moves from frame to frame, times in frames
+class SceneAnimation {
+    public:
+        int frameCount = 1;
+        // Fraction of a frame the shutter stays open: frame f sees the scene from time f to f + shutter
+        double shutter = 0.0;
+        KeyframeTrack<CameraRecord> camera;
+        // Sphere number (order of the scene) and its center
+        std::vector<std::pair<uint32_t, KeyframeTrack<Vec3>>> spheres;
+
+    private:
+        // Position of every sphere's track in spheres
+        std::unordered_map<uint32_t, size_t> mTrackOf;
+
+    public:
+        static SceneAnimation FromDescription(const SceneDescription& description) {
+            SceneAnimation animation;
+            animation.frameCount = description.frameCount;
+            animation.shutter = description.shutter;
+            for (const CameraKeyRecord& key : description.cameraKeys) {
+                animation.camera.Add(key.frame, key.camera);
+            }
+            for (const SphereKeyRecord& key : description.sphereKeys) {
+                animation.SphereTrack(key.sphere).Add(key.frame, Vec3(key.center[0], key.center[1], key.center[2]));
+            }
+            return animation;
+        }
+
+        // One turn of the camera around the vertical axis through lookAt, ending where it started after frameCount frames
+        void AddTurntable(const CameraRecord& start, int frames) {
+            const int keysPerTurn = 64;
+            double dx = start.lookFrom[0] - start.lookAt[0];
+            double dz = start.lookFrom[2] - start.lookAt[2];
+            for (int k = 0; k <= keysPerTurn; k++) {
+                double angle = 2.0 * pi * k / keysPerTurn;
+                CameraRecord c = start;
+                c.lookFrom[0] = start.lookAt[0] + dx * std::cos(angle) - dz * std::sin(angle);
+                c.lookFrom[2] = start.lookAt[2] + dx * std::sin(angle) + dz * std::cos(angle);
+                camera.Add(double(frames) * k / keysPerTurn, c);
+            }
+        }
+
+        KeyframeTrack<Vec3>& SphereTrack(uint32_t sphere) {
+            auto found = mTrackOf.find(sphere);
+            if (found != mTrackOf.end()) {
+                return spheres[found->second].second;
+            }
+            mTrackOf[sphere] = spheres.size();
+            spheres.push_back(std::make_pair(sphere, KeyframeTrack<Vec3>()));
+            return spheres.back().second;
+        }
+
+        bool MovesCamera() const { return !camera.Empty(); }
+        bool MovesSpheres() const { return !spheres.empty(); }
+
+        // Camera of the frame at shutter open, and at shutter close when it moves during the frame
+        CameraRecord CameraAt(double frame, const CameraRecord& still) const {
+            if (camera.Empty()) {
+                return still;
+            }
+            CameraRecord c = camera.At(frame);
+            c.aspectRatio = still.aspectRatio;
+            return c;
+        }
+};
+
+// Numbered output of a frame: image.png -> image_0007.png
+inline std::string FramePath(const std::string& path, int frame) {
+    char number[16];
+    std::snprintf(number, sizeof(number), "_%04d", frame);
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + number;
+    }
+    return path.substr(0, dot) + number + path.substr(dot);
+}
+
+// Time spent getting the acceleration structure ready for one frame
+struct FrameSetupStats {
+    double updateMilliseconds = 0.0;
+    double refitMilliseconds = 0.0;
+    // Rebuilds done because refits had degraded the tree too much
+    double rebuildMilliseconds = 0.0;
+    bool rebuilt = false;
+    double sahCost = 0.0;
+    // Comparison only (SetFrame(..., true)): time and tree cost of a full rebuild of the same frame
+    double fullRebuildMilliseconds = 0.0;
+    double fullRebuildSahCost = 0.0;
+};
+
+// Moves the animated spheres of a SphereBvh from frame to frame and refits the tree instead of building it again
+// The tree is only rebuilt once its SAH cost has grown past rebuildFactor times its cost after the last build
+class AnimatedSphereBvh {
+    private:
+        SphereBvh& mBvh;
+        // Leaf of every sphere of the scene, follows the rebuilds
+        std::vector<uint32_t> mLeafOf;
+        double mBuiltCost;
+
+    public:
+        double rebuildFactor = 1.5;
+
+    public:
+        explicit AnimatedSphereBvh(SphereBvh& bvh) : mBvh(bvh), mLeafOf(bvh.PrimitiveCount()), mBuiltCost(bvh.SahCost()) {
+            for (size_t i = 0; i < mLeafOf.size(); i++) {
+                mLeafOf[i] = static_cast<uint32_t>(bvh.LeafIndex(i));
+            }
+        }
+
+        FrameSetupStats SetFrame(const SceneAnimation& animation, double frame, bool compareRebuild) {
+            using namespace std::chrono;
+            FrameSetupStats stats;
+            auto milliseconds = [](steady_clock::time_point start) { return duration<double, std::milli>(steady_clock::now() - start).count(); };
+
+            auto start = steady_clock::now();
+            SphereBatch& leaves = mBvh.MutableLeaves();
+            for (const auto& track : animation.spheres) {
+                if (track.first >= mLeafOf.size()) {
+                    continue;
+                }
+                size_t leaf = mLeafOf[track.first];
+                Vec3 open = track.second.At(frame);
+                leaves.SetCenter(leaf, open);
+                leaves.SetMotion(leaf, track.second.At(frame + animation.shutter) - open);
+            }
+            stats.updateMilliseconds = milliseconds(start);
+
+            start = steady_clock::now();
+            mBvh.Refit();
+            stats.refitMilliseconds = milliseconds(start);
+            stats.sahCost = mBvh.SahCost();
+
+            if (compareRebuild) {
+                start = steady_clock::now();
+                SphereBvh rebuilt(mBvh.Leaves());
+                stats.fullRebuildMilliseconds = milliseconds(start);
+                stats.fullRebuildSahCost = rebuilt.SahCost();
+            }
+
+            if (stats.sahCost > rebuildFactor * mBuiltCost) {
+                start = steady_clock::now();
+                SphereBvh rebuilt(mBvh.Leaves());
+                for (uint32_t& leaf : mLeafOf) {
+                    leaf = static_cast<uint32_t>(rebuilt.LeafIndex(leaf));
+                }
+                mBvh = std::move(rebuilt);
+                stats.rebuildMilliseconds = milliseconds(start);
+                stats.rebuilt = true;
+                stats.sahCost = mBuiltCost = mBvh.SahCost();
+            }
+
+            return stats;
+        }
+};
+
+void PrintFrameSetupReport(std::ostream& out, const FrameSetupStats& stats) {
+    out << "Frame setup: update " << stats.updateMilliseconds << " ms + refit " << stats.refitMilliseconds << " ms";
+    if (stats.rebuilt) {
+        out << " + rebuild " << stats.rebuildMilliseconds << " ms (refit tree had degraded)";
+    }
+    out << " | SAH cost " << stats.sahCost;
+    if (stats.fullRebuildMilliseconds > 0.0) {
+        out << " | full rebuild " << stats.fullRebuildMilliseconds << " ms, SAH cost " << stats.fullRebuildSahCost;
+    }
+    out << "\n";
+}
+
+#endif //ANIMATION_H
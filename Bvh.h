@@ -0,0 +1,200 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "Hittable.h"
+#include "HittableList.h"
+
+struct BvhStats {
+    int nodeCount = 0;
+    int leafCount = 0;
+    int maxDepth = 0;
+    double buildMilliseconds = 0.0;
+};
+
+// Binned surface area heuristic over [begin, end[, boxOf(element) gives the box of one element
+// Partitions the range along the cheapest plane and returns the split point, or begin when the centroids can't be separated
+// splitCost receives the (unnormalized) cost of the split: sum over both sides of area * element count
+// splitAxis receives the axis of the plane, the first part of the range lies on its low side
+template <typename Iterator, typename BoxGetter>
+Iterator SahPartition(Iterator begin, Iterator end, BoxGetter boxOf, double* splitCost = nullptr, int* splitAxis = nullptr) {
+    const int binCount = 16;
+
+    Aabb centroidBounds;
+    for (Iterator it = begin; it != end; ++it) {
+        centroidBounds.Grow(boxOf(*it).Centroid());
+    }
+
+    double bestCost = infinity;
+    int bestAxis = -1;
+    int bestBin = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double lo = centroidBounds.min()[axis];
+        double extent = centroidBounds.max()[axis] - lo;
+        if (extent <= 0.0) {
+            continue;
+        }
+
+        Aabb binBoxes[binCount];
+        int binCounts[binCount] = {};
+        for (Iterator it = begin; it != end; ++it) {
+            Aabb box = boxOf(*it);
+            int bin = std::min(binCount - 1, static_cast<int>(binCount * (box.Centroid()[axis] - lo) / extent));
+            binCounts[bin]++;
+            binBoxes[bin].Grow(box);
+        }
+
+        // Sweep from the right to know the area and count of every right side
+        double rightAreas[binCount];
+        int rightCounts[binCount];
+        Aabb rightBox;
+        int rightCount = 0;
+        for (int b = binCount - 1; b > 0; b--) {
+            rightBox.Grow(binBoxes[b]);
+            rightCount += binCounts[b];
+            rightAreas[b] = rightBox.SurfaceArea();
+            rightCounts[b] = rightCount;
+        }
+
+        Aabb leftBox;
+        int leftCount = 0;
+        for (int b = 0; b < binCount - 1; b++) {
+            leftBox.Grow(binBoxes[b]);
+            leftCount += binCounts[b];
+            if (leftCount == 0 || rightCounts[b + 1] == 0) {
+                continue;
+            }
+
+            double cost = leftBox.SurfaceArea() * leftCount + rightAreas[b + 1] * rightCounts[b + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = b;
+            }
+        }
+    }
+
+    if (splitCost) {
+        *splitCost = bestCost;
+    }
+    if (splitAxis) {
+        *splitAxis = bestAxis;
+    }
+    if (bestAxis < 0) {
+        return begin;
+    }
+
+    double lo = centroidBounds.min()[bestAxis];
+    double extent = centroidBounds.max()[bestAxis] - lo;
+    return std::partition(begin, end, [&](const typename std::iterator_traits<Iterator>::value_type& element) {
+        int bin = std::min(binCount - 1, static_cast<int>(binCount * (boxOf(element).Centroid()[bestAxis] - lo) / extent));
+        return bin <= bestBin;
+    });
+}
+
+// Bounding volume hierarchy, a drop-in Hittable that only visits the objects whose boxes are crossed by the ray
+class BvhNode : public Hittable {
+    public:
+        shared_ptr<Hittable> mLeft;
+        shared_ptr<Hittable> mRight;
+        Aabb mBox;
+
+    public:
+        BvhNode() {}
+        BvhNode(const HittableList& list, BvhStats* stats = nullptr) {
+            auto start = std::chrono::steady_clock::now();
+
+            std::vector<shared_ptr<Hittable>> objects = list.objects;
+            Build(objects, 0, objects.size(), stats, 0);
+
+            if (stats) {
+                stats->buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+        BvhNode(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, BvhStats* stats, int depth) {
+            Build(objects, start, end, stats, depth);
+        }
+
+        virtual bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const override {
+            if (!mBox.Hit(r, tMin, tMax)) {
+                return false;
+            }
+
+            bool hitLeft = mLeft->Hit(r, tMin, tMax, rec);
+            // Single object leaves point to the same object twice
+            bool hitRight = mRight != mLeft && mRight->Hit(r, tMin, hitLeft ? rec.t : tMax, rec);
+
+            return hitLeft || hitRight;
+        }
+
+        // An empty node has no box, like an empty HittableList
+        virtual bool BoundingBox(Aabb& outputBox) const override {
+            outputBox = mBox;
+            return mLeft != nullptr;
+        }
+
+        static Aabb BoxOf(const shared_ptr<Hittable>& object) {
+            Aabb box;
+            if (!object->BoundingBox(box)) {
+                std::cerr << "No bounding box in BvhNode constructor.\n";
+            }
+            return box;
+        }
+
+        // Returns the index splitting [start, end[ in two, or start when no split is worth it
+        static size_t SahSplit(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end) {
+            auto middle = SahPartition(objects.begin() + start, objects.begin() + end, BoxOf);
+            return static_cast<size_t>(middle - objects.begin());
+        }
+
+    private:
+        void Build(std::vector<shared_ptr<Hittable>>& objects, size_t start, size_t end, BvhStats* stats, int depth) {
+            size_t count = end - start;
+
+            // Nothing to split, the node keeps its empty box and no ray enters it
+            if (count == 0) {
+                return;
+            }
+
+            if (stats) {
+                stats->nodeCount++;
+                stats->maxDepth = std::max(stats->maxDepth, depth);
+            }
+
+            if (count == 1) {
+                mLeft = mRight = objects[start];
+                if (stats) stats->leafCount++;
+            }
+            else if (count == 2) {
+                mLeft = objects[start];
+                mRight = objects[start + 1];
+                if (stats) stats->leafCount++;
+            }
+            else {
+                size_t mid = SahSplit(objects, start, end);
+
+                // All centroids in the same place, fall back on an arbitrary half split
+                if (mid == start || mid == end) {
+                    mid = start + count / 2;
+                }
+
+                mLeft = make_shared<BvhNode>(objects, start, mid, stats, depth + 1);
+                mRight = make_shared<BvhNode>(objects, mid, end, stats, depth + 1);
+            }
+
+            mBox = SurroundingBox(BoxOf(mLeft), BoxOf(mRight));
+        }
+};
+
+void PrintBvhReport(std::ostream& out, const BvhStats& stats, size_t objectCount) {
+    out << "BVH: " << objectCount << " objects, " << stats.nodeCount << " nodes, " << stats.leafCount << " leaves, depth " << stats.maxDepth
+        << " | build " << stats.buildMilliseconds << " ms\n";
+}
+
+#endif //BVH_H
@@ -4,6 +4,7 @@
 #include "Utility.h"
 #include "Vec3.h"
 #include "Ray.h"
+#include "Sampling.h"
 
 class Camera {
     private:
@@ -12,7 +13,10 @@ class Camera {
         Vec3 mHorizontal;
         Vec3 mVertical;
         Vec3 mU, mV, mW;
-        double mLensRadius;
+        Real mLensRadius;
+        // Change of the frame between shutter open and close (SetShutterClose()), all zero for a still camera
+        bool mMoving = false;
+        Vec3 mOriginMotion, mLowerLeftCornerMotion, mHorizontalMotion, mVerticalMotion, mUMotion, mVMotion;
 
     public:
         Camera(Vec3 lookfrom, Vec3 lookAt, Vec3 vup, double vertFov, double aspectRatio, double aperture, double focusDistance) {
@@ -29,15 +33,55 @@ class Camera {
             mHorizontal = focusDistance * viewportWidth * mU;
             mVertical = focusDistance * viewportHeight * mV;
             mLowerLeftCorner = mOrigin - mHorizontal / 2 - mVertical / 2 - focusDistance * mW;
+
+            mLensRadius = aperture / 2.0;
+        }
+
+        // The camera moves linearly from this frame at shutter open to close's at shutter close, for motion blur
+        // The lens radius stays the one of this camera
+        void SetShutterClose(const Camera& close) {
+            mOriginMotion = close.mOrigin - mOrigin;
+            mLowerLeftCornerMotion = close.mLowerLeftCorner - mLowerLeftCorner;
+            mHorizontalMotion = close.mHorizontal - mHorizontal;
+            mVerticalMotion = close.mVertical - mVertical;
+            mUMotion = close.mU - mU;
+            mVMotion = close.mV - mV;
+            mMoving = !(mOriginMotion.NearZero() && mLowerLeftCornerMotion.NearZero() && mHorizontalMotion.NearZero() && mVerticalMotion.NearZero()
+                        && mUMotion.NearZero() && mVMotion.NearZero());
         }
 
-        Ray GetRay(double s, double t) const {
+        Ray GetRay(Real s, Real t) const {
+            Real lensU = RandomDouble();
+            return GetRay(s, t, lensU, RandomDouble());
+        }
+
+        // lensU and lensV in [0, 1[ pick the point of the lens, time in [0, 1[ the instant within the shutter interval
+        Ray GetRay(Real s, Real t, Real lensU, Real lensV, Real time = 0) const {
+            Vec3 origin = mOrigin;
+            Vec3 lowerLeftCorner = mLowerLeftCorner;
+            Vec3 horizontal = mHorizontal;
+            Vec3 vertical = mVertical;
+            Vec3 u = mU;
+            Vec3 v = mV;
+            if (mMoving) {
+                origin += time * mOriginMotion;
+                lowerLeftCorner += time * mLowerLeftCornerMotion;
+                horizontal += time * mHorizontalMotion;
+                vertical += time * mVerticalMotion;
+                u += time * mUMotion;
+                v += time * mVMotion;
+            }
+
             // Generating sample rays from inside a disk centered at the lookfrom point
             // Larger the radius, greater the focus blur
-            Vec3 raysfromDisk = mLensRadius * RandomInUnitDisk();
-            Vec3 offset = mU * raysfromDisk.x() + mV * raysfromDisk.y(); 
+            // A pinhole (no aperture) skips the disk mapping and its trigonometry
+            Vec3 offset(0, 0, 0);
+            if (mLensRadius > 0) {
+                Vec3 raysfromDisk = mLensRadius * ConcentricDisk(lensU, lensV);
+                offset = u * raysfromDisk.x() + v * raysfromDisk.y();
+            }
 
-            return Ray(mOrigin + offset, mLowerLeftCorner + s*mHorizontal + t*mVertical - mOrigin - offset);
+            return Ray(origin + offset, lowerLeftCorner + s*horizontal + t*vertical - origin - offset, time);
         }
 };
 
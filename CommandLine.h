@@ -0,0 +1,366 @@
+#ifndef COMMAND_LINE_H
+#define COMMAND_LINE_H
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Camera.h"
+#include "Denoiser.h"
+#include "Progressive.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+
+// One frame to render: its settings, camera and output
+struct RenderJob {
+    RenderSettings settings;
+    CameraRecord camera;
+    std::string outputPath = "output.ppm";
+    // Samples per pixel heatmap of adaptive sampling, empty for none
+    std::string heatmapPath;
+    // Time of every tile as an image, empty for none
+    std::string tileCostPath;
+    bool progressive = false;
+    ProgressiveSettings passes;
+    // Filter the frame with the AOVs before writing it
+    bool denoise = false;
+    DenoiseSettings denoiseSettings;
+    // Albedo, normal and depth images go to <prefix>-albedo.<ext>... when not empty
+    std::string aovPrefix;
+    // Frame of an animation (--frames), the scene is moved to it before rendering
+    int frame = 0;
+    // Camera at shutter close when it moves during the frame
+    bool cameraMoves = false;
+    CameraRecord cameraClose;
+
+    // Scene as seen by this job: sceneHash (SceneDescription::Hash()) with the frame, the shutter and the cameras
+    uint64_t SceneHash(uint64_t sceneHash, double shutter) const {
+        uint64_t hash = HashBytes(sceneHash, &frame);
+        hash = HashBytes(hash, &shutter);
+        hash = HashBytes(hash, &camera);
+        return cameraMoves ? HashBytes(hash, &cameraClose) : hash;
+    }
+
+    Camera MakeCamera() const {
+        Camera cam = MakeCamera(camera);
+        if (cameraMoves) {
+            cam.SetShutterClose(MakeCamera(cameraClose));
+        }
+        return cam;
+    }
+
+    Camera MakeCamera(const CameraRecord& c) const {
+        double aspectRatio = c.aspectRatio > 0.0 ? c.aspectRatio : double(settings.imageWidth) / settings.imageHeight;
+        return Camera(Vec3(c.lookFrom[0], c.lookFrom[1], c.lookFrom[2]), Vec3(c.lookAt[0], c.lookAt[1], c.lookAt[2]), Vec3(c.vup[0], c.vup[1], c.vup[2]),
+                      c.verticalFov, aspectRatio, c.aperture, c.focusDistance);
+    }
+};
+
+// Options of the whole run, the job options given with them are the defaults of every job of the list
+struct BatchOptions {
+    std::string scenePath;
+    std::string jobsPath;
+    // Detailed reports after every frame (BVH, tiles, paths...): 1 on, 0 off, -1 only when there is a single frame
+    int reports = -1;
+    bool benchmarkHandles = false;
+    bool benchmarkImageWrites = false;
+    bool benchmarkSceneLoad = false;
+    bool benchmarkDenoise = false;
+    bool benchmarkInstances = false;
+    bool benchmarkLights = false;
+    // Animation: frame count and shutter of the scene file unless given (-1), --turntable orbits the camera
+    int frames = -1;
+    double shutter = -1.0;
+    bool turntable = false;
+    // Coordinator of that many worker processes (Distributed.h), 0 renders in this process only
+    int workers = 0;
+    // Set on the workers the coordinator starts: their end of its socket
+    int workerFd = -1;
+    // Testing: the first worker dies while sending its tile number n
+    int crashWorkerAfter = -1;
+    // The options the workers are started with: all of them but the coordinator's own
+    std::vector<std::string> workerArguments;
+    bool help = false;
+    std::vector<std::string> jobArguments;
+};
+
+void PrintUsage(std::ostream& out) {
+    out << "Usage: Raytracer [options]\n"
+        << "Run options:\n"
+        << "  --scene <file>          scene file (text, or binary .sceneb), the built-in scene otherwise\n"
+        << "  --jobs <file>           one job per line, each line holds job options applied over the command line ones\n"
+        << "  --reports, --no-reports detailed statistics after every frame\n"
+        << "  --frames <n>            render n frames of the scene's keyframes, output names get _0000, _0001...\n"
+        << "  --shutter <fraction>    part of a frame the shutter stays open, for motion blur (0 by default)\n"
+        << "  --turntable             one turn of the camera around its look-at point over the frames\n"
+        << "  --workers <n>           split every frame over n worker processes, which load the same scene and jobs\n"
+        << "                          (progressive jobs still render in this process)\n"
+        << "  --crash-worker-after <n> testing: the first worker dies while sending its tile number n\n"
+        << "  --benchmark-handles     shared_ptr against raw material handles on RandomScene\n"
+        << "  --benchmark-images      image write times at 4K and 8K\n"
+        << "  --benchmark-scenes      scene load times for a million spheres\n"
+        << "  --benchmark-denoise     quality and time of 16 to 64 spp denoised frames against the job's spp (500 by default)\n"
+        << "  --benchmark-instances   memory and rays/s of 10k to 1M instanced sphere groups against the same spheres flattened\n"
+        << "  --benchmark-lights      error of 4 to 256 spp frames of a small light scene, with and without light sampling\n"
+        << "Job options:\n"
+        << "  --width <n> --height <n> --spp <n> --depth <n> --seed <n> --roulette <depth>\n"
+        << "  --threads <n> --tile <n> --integrator iterative|wavefront --packets, --no-packets\n"
+        << "  --sampler random|halton|sobol  source of the pixel position and lens numbers (default sobol)\n"
+        << "  --light-sampling, --no-light-sampling  shadow rays toward the emitters at every diffuse bounce (default on)\n"
+        << "  --sky <intensity>       scale of the sky gradient, 0 to light the scene with its emitters only\n"
+        << "  --adaptive, --no-adaptive  more samples for the noisy pixels, instead of packets or the wavefront (default off)\n"
+        << "  --adaptive-threshold <t> --heatmap <file>\n"
+        << "  --progressive --pass-samples <n> --checkpoint <file> --preview <file>\n"
+        << "  --look-from x,y,z --look-at x,y,z --up x,y,z --fov <degrees> --aperture <a> --focus <distance> --aspect <ratio>\n"
+        << "  --output <file>         .ppm, .pfm or .png\n"
+        << "  --tile-cost <file>      time spent on every tile, as a P3 heatmap\n"
+        << "  --denoise, --no-denoise filter the frame guided by its albedo, normal and depth buffers\n"
+        << "  --denoise-passes <n>    a-trous passes, each doubles the filter footprint (5 by default)\n"
+        << "  --aovs <prefix>         write <prefix>-albedo, -normal and -depth in the format of --output\n";
+}
+
+// Reads x,y,z
+bool ParseVector(const std::string& text, double* values) {
+    std::istringstream in(text);
+    char comma1 = 0;
+    char comma2 = 0;
+    return static_cast<bool>(in >> values[0] >> comma1 >> values[1] >> comma2 >> values[2]) && comma1 == ',' && comma2 == ',';
+}
+
+// Applies the job options of args over job, false (and error set) on the first bad one
+bool ParseJobOptions(const std::vector<std::string>& args, RenderJob& job, std::string& error) {
+    RenderSettings& s = job.settings;
+
+    for (size_t i = 0; i < args.size(); i++) {
+        const std::string& option = args[i];
+
+        // Flags without value
+        if (option == "--packets") { s.usePackets = true; continue; }
+        if (option == "--no-packets") { s.usePackets = false; continue; }
+        if (option == "--adaptive") { s.adaptive = true; continue; }
+        if (option == "--no-adaptive") { s.adaptive = false; continue; }
+        if (option == "--progressive") { job.progressive = true; s.adaptive = false; continue; }
+        if (option == "--denoise") { job.denoise = true; continue; }
+        if (option == "--no-denoise") { job.denoise = false; continue; }
+        if (option == "--light-sampling") { s.sampleLights = true; continue; }
+        if (option == "--no-light-sampling") { s.sampleLights = false; continue; }
+
+        if (i + 1 >= args.size()) {
+            error = "missing value after " + option;
+            return false;
+        }
+        const std::string& value = args[++i];
+        char* end = nullptr;
+        double number = strtod(value.c_str(), &end);
+        bool isNumber = end != value.c_str() && *end == '\0';
+
+        auto needNumber = [&]() {
+            if (!isNumber) {
+                error = option + " expects a number, got " + value;
+            }
+            return isNumber;
+        };
+
+        if (option == "--width") { if (!needNumber()) return false; s.imageWidth = static_cast<int>(number); }
+        else if (option == "--height") { if (!needNumber()) return false; s.imageHeight = static_cast<int>(number); }
+        else if (option == "--spp") { if (!needNumber()) return false; s.samplesPerPixel = static_cast<int>(number); }
+        else if (option == "--depth") { if (!needNumber()) return false; s.maxDepth = static_cast<int>(number); }
+        else if (option == "--seed") { if (!needNumber()) return false; s.seed = std::strtoull(value.c_str(), nullptr, 10); }
+        else if (option == "--roulette") { if (!needNumber()) return false; s.rouletteMinDepth = static_cast<int>(number); }
+        else if (option == "--threads") { if (!needNumber()) return false; s.threadCount = static_cast<int>(number); }
+        else if (option == "--tile") { if (!needNumber()) return false; s.tileSize = static_cast<int>(number); }
+        else if (option == "--adaptive-threshold") { if (!needNumber()) return false; s.adaptiveThreshold = number; }
+        else if (option == "--pass-samples") { if (!needNumber()) return false; job.passes.passSamples = static_cast<int>(number); }
+        else if (option == "--fov") { if (!needNumber()) return false; job.camera.verticalFov = number; }
+        else if (option == "--aperture") { if (!needNumber()) return false; job.camera.aperture = number; }
+        else if (option == "--focus") { if (!needNumber()) return false; job.camera.focusDistance = number; }
+        else if (option == "--aspect") { if (!needNumber()) return false; job.camera.aspectRatio = number; }
+        else if (option == "--sky") { if (!needNumber()) return false; s.skyIntensity = number; }
+        else if (option == "--integrator") {
+            if (value == "iterative") s.integrator = IntegratorMode::Iterative;
+            else if (value == "wavefront") s.integrator = IntegratorMode::Wavefront;
+            else { error = "unknown integrator " + value; return false; }
+        }
+        else if (option == "--sampler") {
+            if (value == "random") s.sampler = SamplerKind::Random;
+            else if (value == "halton") s.sampler = SamplerKind::Halton;
+            else if (value == "sobol") s.sampler = SamplerKind::Sobol;
+            else { error = "unknown sampler " + value; return false; }
+        }
+        else if (option == "--look-from" || option == "--look-at" || option == "--up") {
+            double* target = option == "--look-from" ? job.camera.lookFrom : option == "--look-at" ? job.camera.lookAt : job.camera.vup;
+            if (!ParseVector(value, target)) {
+                error = option + " expects x,y,z, got " + value;
+                return false;
+            }
+        }
+        else if (option == "--output") { job.outputPath = value; }
+        else if (option == "--heatmap") { job.heatmapPath = value; }
+        else if (option == "--tile-cost") { job.tileCostPath = value; }
+        else if (option == "--checkpoint") { job.passes.checkpointPath = value; }
+        else if (option == "--preview") { job.passes.previewPath = value; }
+        else if (option == "--aovs") { job.aovPrefix = value; }
+        else if (option == "--denoise-passes") { if (!needNumber()) return false; job.denoiseSettings.passes = static_cast<int>(number); }
+        else {
+            error = "unknown option " + option;
+            return false;
+        }
+    }
+
+    if (s.imageWidth <= 0 || s.imageHeight <= 0 || s.samplesPerPixel <= 0) {
+        error = "the image size and the samples per pixel must be positive";
+        return false;
+    }
+    // Taps 2^pass pixels apart, 16 passes already span more than any image
+    if (job.denoiseSettings.passes < 0 || job.denoiseSettings.passes > DenoiseSettings::maxPasses) {
+        error = "--denoise-passes must be between 0 and " + std::to_string(DenoiseSettings::maxPasses);
+        return false;
+    }
+    return true;
+}
+
+// Splits the run options from the job options
+bool ParseCommandLine(int argc, char** argv, BatchOptions& options, std::string& error) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+
+        if (option == "--help" || option == "-h") { options.help = true; }
+        else if (option == "--reports") { options.reports = 1; }
+        else if (option == "--no-reports") { options.reports = 0; }
+        else if (option == "--benchmark-handles") { options.benchmarkHandles = true; }
+        else if (option == "--benchmark-images") { options.benchmarkImageWrites = true; }
+        else if (option == "--benchmark-scenes") { options.benchmarkSceneLoad = true; }
+        else if (option == "--benchmark-denoise") { options.benchmarkDenoise = true; }
+        else if (option == "--benchmark-instances") { options.benchmarkInstances = true; }
+        else if (option == "--benchmark-lights") { options.benchmarkLights = true; }
+        else if (option == "--turntable") { options.turntable = true; }
+        else if (option == "--workers" || option == "--worker-fd" || option == "--crash-worker-after") {
+            if (i + 1 >= argc) {
+                error = "missing value after " + option;
+                return false;
+            }
+            // A descriptor or a tile count can be 0, not the worker count
+            long minimum = option == "--workers" ? 1 : 0;
+            char* end = nullptr;
+            long number = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || number < minimum) {
+                error = option + (minimum > 0 ? " expects a positive integer, got " : " expects a non-negative integer, got ") + argv[i];
+                return false;
+            }
+            if (option == "--workers") options.workers = static_cast<int>(number);
+            else if (option == "--worker-fd") options.workerFd = static_cast<int>(number);
+            else options.crashWorkerAfter = static_cast<int>(number);
+            continue;
+        }
+        else if (option == "--frames") {
+            if (i + 1 >= argc) {
+                error = "missing value after " + option;
+                return false;
+            }
+            char* end = nullptr;
+            long number = strtol(argv[++i], &end, 10);
+            if (end == argv[i] || *end != '\0' || number < 1) {
+                error = option + " expects a positive integer, got " + argv[i];
+                return false;
+            }
+            options.frames = static_cast<int>(number);
+        }
+        else if (option == "--shutter") {
+            if (i + 1 >= argc) {
+                error = "missing value after " + option;
+                return false;
+            }
+            char* end = nullptr;
+            double number = strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !(number >= 0.0)) {
+                error = option + " expects a non-negative number, got " + argv[i];
+                return false;
+            }
+            options.shutter = number;
+        }
+        else if (option == "--scene" || option == "--jobs") {
+            if (i + 1 >= argc) {
+                error = "missing value after " + option;
+                return false;
+            }
+            (option == "--scene" ? options.scenePath : options.jobsPath) = argv[++i];
+        }
+        else {
+            options.jobArguments.push_back(option);
+        }
+        options.workerArguments.push_back(option);
+        if (option == "--frames" || option == "--shutter" || option == "--scene" || option == "--jobs") {
+            options.workerArguments.push_back(argv[i]);
+        }
+    }
+    return true;
+}
+
+// Every job of the list file: whitespace separated job options, one line per job, # starts a comment
+// A list without any job is an error
+bool ReadJobList(const std::string& path, const RenderJob& defaults, std::vector<RenderJob>& jobs) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Can't read job list " << path << ".\n";
+        return false;
+    }
+
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream words(line);
+        std::vector<std::string> args;
+        for (std::string word; words >> word; ) {
+            args.push_back(word);
+        }
+        if (args.empty()) {
+            continue;
+        }
+
+        RenderJob job = defaults;
+        std::string error;
+        if (!ParseJobOptions(args, job, error)) {
+            std::cerr << path << ":" << lineNumber << ": " << error << "\n";
+            return false;
+        }
+        jobs.push_back(job);
+    }
+
+    if (jobs.empty()) {
+        std::cerr << "No jobs in " << path << ".\n";
+        return false;
+    }
+    return true;
+}
+
+// Throughput of a batch
+struct BatchStats {
+    int frames = 0;
+    double seconds = 0.0;
+    uint64_t rays = 0;
+    uint64_t samples = 0;
+
+    void Add(double frameSeconds, const PathCounters& counters) {
+        frames++;
+        seconds += frameSeconds;
+        rays += counters.segments;
+        samples += counters.paths;
+    }
+};
+
+void PrintBatchSummary(std::ostream& out, const BatchStats& stats, double setupSeconds) {
+    if (stats.frames == 0 || stats.seconds <= 0.0) {
+        return;
+    }
+
+    out << "Batch: " << stats.frames << " frames in " << stats.seconds << " s (+ " << setupSeconds << " s scene setup) | "
+        << stats.frames * 3600.0 / stats.seconds << " frames/hour | "
+        << stats.rays / stats.seconds / 1e6 << " Mrays/s | "
+        << stats.samples / stats.seconds / 1e6 << " Msamples/s\n";
+}
+
+#endif //COMMAND_LINE_H
@@ -0,0 +1,74 @@
+#ifndef DENOISE_BENCHMARK_H
+#define DENOISE_BENCHMARK_H
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "Camera.h"
+#include "Denoiser.h"
+#include "Framebuffer.h"
+#include "Hittable.h"
+#include "ImageDiff.h"
+#include "Renderer.h"
+
+// Quality against time of denoised low sample renders, the reference being the renderer's own settings (500 spp in
+// main()). Adaptive sampling is turned off so every frame spends exactly its sample count
+void RunDenoiseBenchmark(std::ostream& out, TileRenderer& renderer, const Hittable& world, const Camera& cam,
+                         const DenoiseSettings& denoiseSettings, const std::vector<int>& sampleCounts = { 16, 32, 64 }) {
+    using namespace std::chrono;
+    const RenderSettings settings = renderer.Settings();
+    RenderSettings fixed = settings;
+    fixed.adaptive = false;
+    int width = settings.imageWidth;
+    int height = settings.imageHeight;
+
+    auto milliseconds = [](steady_clock::time_point start) {
+        return duration<double, std::milli>(steady_clock::now() - start).count();
+    };
+
+    renderer.SetSettings(fixed);
+    Framebuffer referenceFrame(width, height);
+    auto start = steady_clock::now();
+    renderer.Render(world, cam, referenceFrame);
+    double referenceMs = milliseconds(start);
+    FloatImage reference = ToFloatImage(referenceFrame);
+
+    out << "\rDenoising against " << fixed.samplesPerPixel << " spp (" << referenceMs << " ms), " << width << "x" << height
+        << ", " << denoiseSettings.passes << " passes:\n";
+    for (int samples : sampleCounts) {
+        RenderSettings low = fixed;
+        low.samplesPerPixel = samples;
+        renderer.SetSettings(low);
+
+        Framebuffer noisy(width, height);
+        start = steady_clock::now();
+        renderer.Render(world, cam, noisy);
+        double renderMs = milliseconds(start);
+
+        AovBuffers aovs(width, height);
+        start = steady_clock::now();
+        renderer.RenderAovs(world, cam, aovs);
+        double aovMs = milliseconds(start);
+
+        Framebuffer denoised(width, height);
+        start = steady_clock::now();
+        Denoise(noisy, aovs, denoiseSettings, renderer.Pool(), denoised);
+        double denoiseMs = milliseconds(start);
+
+        ImageDifference raw = CompareImages(ToFloatImage(noisy), reference);
+        ImageDifference filtered = CompareImages(ToFloatImage(denoised), reference);
+        double totalMs = renderMs + aovMs + denoiseMs;
+        // Noise falls as 1 / sqrt(spp): samples the plain render would need to get down to the denoised error
+        double equivalentSamples = filtered.rmse > 0.0 ? samples * (raw.rmse / filtered.rmse) * (raw.rmse / filtered.rmse) : 0.0;
+
+        out << "\r  " << samples << " spp: render " << renderMs << " ms + aovs " << aovMs << " ms + denoise " << denoiseMs << " ms = "
+            << totalMs << " ms (" << 100.0 * totalMs / referenceMs << "% of the reference) | PSNR " << raw.psnr << " -> "
+            << filtered.psnr << " dB | RMSE " << raw.rmse << " -> " << filtered.rmse << " (~" << equivalentSamples
+            << " spp undenoised) | visibly different pixels " << raw.visiblePixelsPercent << "% -> " << filtered.visiblePixelsPercent << "%\n";
+    }
+
+    renderer.SetSettings(settings);
+}
+
+#endif //DENOISE_BENCHMARK_H
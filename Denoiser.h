@@ -0,0 +1,113 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "ThreadPool.h"
+#include "Vec3.h"
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the AOV buffers
+// Every pass blurs with a 5x5 B3 spline kernel whose taps are 2^pass pixels apart, so 5 passes cover 125 pixels for
+// 25 taps each. A tap counts less the more its color, normal, albedo or depth differ from the center pixel's
+// The lighting is filtered without the surface colors (color / albedo) and multiplied back by them, so the textures
+// stay sharp and only the noise of the lighting is blurred
+struct DenoiseSettings {
+    // The tap spacing 1 << pass must stay far from overflowing
+    static const int maxPasses = 16;
+    int passes = 5;
+    // Gaussian falloffs of the edge stopping functions, the color one is halved at every pass as the noise drops
+    double colorSigma = 0.3;
+    double normalSigma = 0.3;
+    double albedoSigma = 0.1;
+    // Relative to the depth of the center pixel
+    double depthSigma = 0.05;
+};
+
+// Writes the denoised average of every pixel of noisy into denoised (one sample per pixel), rows spread over the pool
+void Denoise(const Framebuffer& noisy, const AovBuffers& aovs, const DenoiseSettings& settings, ThreadPool& pool, Framebuffer& denoised) {
+    const int width = noisy.Width();
+    const int height = noisy.Height();
+    const Real minAlbedo = Real(1e-3);
+
+    // Lighting of every pixel: average color divided by the albedo
+    std::vector<Vec3> current(width * height);
+    std::vector<Vec3> next(width * height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int samples = std::max(1, noisy.SampleCount(x, y));
+            Vec3 albedo = aovs.Albedo(x, y);
+            Vec3 color = noisy.At(x, y) / Real(samples);
+            current[y * width + x] = Vec3(color.x() / std::max(albedo.x(), minAlbedo), color.y() / std::max(albedo.y(), minAlbedo),
+                                          color.z() / std::max(albedo.z(), minAlbedo));
+        }
+    }
+
+    const Real kernel[5] = { Real(1.0 / 16), Real(1.0 / 4), Real(3.0 / 8), Real(1.0 / 4), Real(1.0 / 16) };
+    const Real normalFactor = Real(1.0 / (settings.normalSigma * settings.normalSigma));
+    const Real albedoFactor = Real(1.0 / (settings.albedoSigma * settings.albedoSigma));
+    const Real depthFactor = Real(1.0 / (settings.depthSigma * settings.depthSigma));
+
+    for (int pass = 0; pass < settings.passes; pass++) {
+        const int step = 1 << pass;
+        double colorSigma = settings.colorSigma / (1 << pass);
+        const Real colorFactor = Real(1.0 / (colorSigma * colorSigma));
+        std::atomic<int> nextRow(0);
+
+        auto worker = [&]() {
+            for (int y = nextRow++; y < height; y = nextRow++) {
+                for (int x = 0; x < width; x++) {
+                    const Vec3& color = current[y * width + x];
+                    const Vec3& normal = aovs.Normal(x, y);
+                    const Vec3& albedo = aovs.Albedo(x, y);
+                    Real depth = aovs.Depth(x, y);
+                    // Misses have depth 0, a relative depth needs a non zero scale
+                    Real depthScale = depth > 0 ? 1 / depth : 1;
+
+                    Vec3 sum(0, 0, 0);
+                    Real weights = 0;
+                    for (int j = 0; j < 5; j++) {
+                        int qy = y + (j - 2) * step;
+                        if (qy < 0 || qy >= height) continue;
+                        for (int i = 0; i < 5; i++) {
+                            int qx = x + (i - 2) * step;
+                            if (qx < 0 || qx >= width) continue;
+
+                            const Vec3& q = current[qy * width + qx];
+                            Real depthDifference = (aovs.Depth(qx, qy) - depth) * depthScale;
+                            Real exponent = (color - q).squaredLength() * colorFactor
+                                + (normal - aovs.Normal(qx, qy)).squaredLength() * normalFactor
+                                + (albedo - aovs.Albedo(qx, qy)).squaredLength() * albedoFactor
+                                + depthDifference * depthDifference * depthFactor;
+                            Real w = kernel[i] * kernel[j] * std::exp(-std::min(exponent, Real(80)));
+                            sum += w * q;
+                            weights += w;
+                        }
+                    }
+
+                    // The center tap always has weight kernel[2]^2, weights is never 0
+                    next[y * width + x] = sum / weights;
+                }
+            }
+        };
+
+        pool.Run(worker);
+        current.swap(next);
+    }
+
+    denoised = Framebuffer(width, height);
+    denoised.ResetSampleCounts(1);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            Vec3 albedo = aovs.Albedo(x, y);
+            const Vec3& light = current[y * width + x];
+            denoised.At(x, y) = Vec3(light.x() * std::max(albedo.x(), minAlbedo), light.y() * std::max(albedo.y(), minAlbedo),
+                                     light.z() * std::max(albedo.z(), minAlbedo));
+        }
+    }
+}
+
+#endif //DENOISER_H
@@ -0,0 +1,575 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#define RAYTRACER_DISTRIBUTED
+#endif
+
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "Hittable.h"
+#include "Integrator.h"
+#include "Renderer.h"
+
+// Frames split over worker processes: the coordinator starts copies of the executable with the same options, which
+// load the same scene and jobs, then hands them batches of tiles over a socket pair each and merges the tiles they
+// send back. Every pixel only depends on (seed, x, y, sample), so a tile is the same whichever worker renders it and
+// the merged frame is the one a single process would render, bit for bit. A batch only counts once its BatchDone
+// (with the path counters of its tiles) is in: a worker that dies loses its whole open batch, whose tiles go back in
+// the queue for the others (or the coordinator itself once no worker is left)
+
+// Messages in the native layout, both ends being the same executable on the same machine
+enum class MessageType : uint32_t { Hello, RenderTiles, TileResult, BatchDone, Quit };
+
+struct MessageHeader {
+    uint32_t type;
+    // Bytes following the header
+    uint32_t size;
+};
+
+struct HelloMessage {
+    int32_t threads;
+    int32_t pid;
+};
+
+// Followed by count tile indices (int32_t) into the job's MakeTiles()
+struct RenderTilesMessage {
+    int32_t job;
+    int32_t count;
+};
+
+// Followed by the pixels of the tile, row by row
+struct TileResultMessage {
+    int32_t job;
+    int32_t tile;
+    double milliseconds;
+};
+
+struct PixelResult {
+    // Doubles hold a float or double Real exactly
+    double color[3];
+    int32_t samples;
+    int32_t pad;
+};
+
+struct BatchDoneMessage {
+    PathCounters paths;
+    AdaptiveStats adaptive;
+};
+
+#if defined(RAYTRACER_DISTRIBUTED)
+
+// Whole buffers or nothing: false once the other end is gone
+inline bool WriteAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        // No SIGPIPE when the other end died, the error is handled like any other
+        ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+inline bool ReadAll(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        bytes += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+inline bool SendMessage(int fd, MessageType type, const std::vector<char>& payload) {
+    MessageHeader header = { static_cast<uint32_t>(type), static_cast<uint32_t>(payload.size()) };
+    return WriteAll(fd, &header, sizeof(header)) && (payload.empty() || WriteAll(fd, payload.data(), payload.size()));
+}
+
+inline bool ReceiveMessage(int fd, MessageType& type, std::vector<char>& payload) {
+    MessageHeader header;
+    if (!ReadAll(fd, &header, sizeof(header))) {
+        return false;
+    }
+    type = static_cast<MessageType>(header.type);
+    payload.resize(header.size);
+    return header.size == 0 || ReadAll(fd, payload.data(), header.size);
+}
+
+template <typename T>
+void AppendBytes(std::vector<char>& payload, const T& value) {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    payload.insert(payload.end(), bytes, bytes + sizeof(T));
+}
+
+// False, value untouched, when the payload is too short to hold it
+template <typename T>
+bool ReadBytes(const std::vector<char>& payload, size_t offset, T& value) {
+    if (offset > payload.size() || payload.size() - offset < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, payload.data() + offset, sizeof(T));
+    return true;
+}
+
+// Worker side: renders the batches of the coordinator on fd until told to quit or the coordinator is gone
+// prepare(job) readies the renderer and the scene for a job of the list and returns its camera
+// crashAfterTiles >= 0 makes the worker die halfway through sending that tile, to test the coordinator's recovery
+int RunWorker(int fd, TileRenderer& renderer, const Hittable& world, const std::function<Camera(int)>& prepare, int crashAfterTiles = -1) {
+    renderer.ShowProgress(false);
+
+    std::vector<char> payload;
+    AppendBytes(payload, HelloMessage{ renderer.ThreadCount(), static_cast<int32_t>(getpid()) });
+    if (!SendMessage(fd, MessageType::Hello, payload)) {
+        return 1;
+    }
+
+    int currentJob = -1;
+    std::unique_ptr<Camera> cam;
+    std::unique_ptr<Framebuffer> framebuffer;
+    int tilesSent = 0;
+    MessageType type;
+
+    while (ReceiveMessage(fd, type, payload) && type == MessageType::RenderTiles) {
+        // A request that doesn't fit the payload or names tiles the job doesn't have ends the worker
+        RenderTilesMessage request;
+        if (!ReadBytes(payload, 0, request) || request.count < 0
+            || payload.size() != sizeof(RenderTilesMessage) + static_cast<size_t>(request.count) * sizeof(int32_t)) {
+            std::cerr << "Worker " << getpid() << ": malformed request from the coordinator.\n";
+            return 1;
+        }
+        if (request.job != currentJob) {
+            cam.reset(new Camera(prepare(request.job)));
+            currentJob = request.job;
+            framebuffer.reset(new Framebuffer(renderer.Settings().imageWidth, renderer.Settings().imageHeight));
+        }
+
+        std::vector<Tile> allTiles = renderer.MakeTiles();
+        std::vector<int32_t> indices(request.count);
+        std::vector<Tile> tiles;
+        for (int i = 0; i < request.count; i++) {
+            ReadBytes(payload, sizeof(RenderTilesMessage) + i * sizeof(int32_t), indices[i]);
+            if (indices[i] < 0 || static_cast<size_t>(indices[i]) >= allTiles.size()) {
+                std::cerr << "Worker " << getpid() << ": tile " << indices[i] << " requested, the job has " << allTiles.size() << ".\n";
+                return 1;
+            }
+            tiles.push_back(allTiles[indices[i]]);
+        }
+
+        std::vector<TileStats> stats = renderer.RenderTiles(world, *cam, *framebuffer, tiles, 0, renderer.Settings().samplesPerPixel);
+
+        for (int i = 0; i < request.count; i++) {
+            const Tile& tile = tiles[i];
+            payload.clear();
+            AppendBytes(payload, TileResultMessage{ request.job, indices[i], stats[i].milliseconds });
+            for (int y = tile.y0; y < tile.y1; y++) {
+                for (int x = tile.x0; x < tile.x1; x++) {
+                    const Vec3& color = framebuffer->At(x, y);
+                    AppendBytes(payload, PixelResult{ { double(color.x()), double(color.y()), double(color.z()) }, framebuffer->SampleCount(x, y), 0 });
+                }
+            }
+
+            if (tilesSent++ == crashAfterTiles) {
+                // A truncated message, as when a worker is killed while writing
+                MessageHeader header = { static_cast<uint32_t>(MessageType::TileResult), static_cast<uint32_t>(payload.size()) };
+                WriteAll(fd, &header, sizeof(header));
+                WriteAll(fd, payload.data(), payload.size() / 2);
+                _exit(3);
+            }
+            if (!SendMessage(fd, MessageType::TileResult, payload)) {
+                return 1;
+            }
+        }
+
+        payload.clear();
+        AppendBytes(payload, BatchDoneMessage{ renderer.LastPathCounters(), renderer.LastAdaptiveStats() });
+        if (!SendMessage(fd, MessageType::BatchDone, payload)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Coordinator side, see the top of the file
+class TileCoordinator {
+    private:
+        struct Worker {
+            int fd = -1;
+            pid_t pid = -1;
+            int threads = 1;
+            bool alive = false;
+            // Tiles of the open batch, until its BatchDone
+            std::vector<int> inFlight;
+            // Tiles of the open batch already received (pixels merged) and their render times
+            std::vector<std::pair<int, double>> results;
+            uint64_t tilesRendered = 0;
+        };
+
+        std::vector<Worker> mWorkers;
+        PathCounters mPathCounters;
+        AdaptiveStats mAdaptiveStats;
+        int mWorkersLost = 0;
+        uint64_t mTilesReassigned = 0;
+        uint64_t mTilesRenderedLocally = 0;
+
+    public:
+        TileCoordinator() {}
+        TileCoordinator(const TileCoordinator&) = delete;
+        TileCoordinator& operator=(const TileCoordinator&) = delete;
+
+        ~TileCoordinator() {
+            for (Worker& worker : mWorkers) {
+                if (worker.alive) {
+                    SendMessage(worker.fd, MessageType::Quit, std::vector<char>());
+                    close(worker.fd);
+                    waitpid(worker.pid, nullptr, 0);
+                }
+            }
+        }
+
+        // Starts workerCount workers running program with arguments and --worker-fd <their end of the socket pair>,
+        // waits for them to be ready (scene loaded). False when none started
+        // Unless the arguments give --threads, the hardware threads are shared among the workers: each would take all
+        // of them otherwise, while the coordinator's own threads wait for the batches
+        bool Start(int workerCount, const std::string& program, const std::vector<std::string>& arguments, int crashAfterTiles = -1) {
+            std::string threadsPerWorker;
+            if (std::find(arguments.begin(), arguments.end(), "--threads") == arguments.end()) {
+                int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+                threadsPerWorker = std::to_string(std::max(1, hardwareThreads / std::max(1, workerCount)));
+            }
+
+            for (int w = 0; w < workerCount; w++) {
+                int fds[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+                    std::cerr << "Can't create the socket of worker " << w << ": " << std::strerror(errno) << "\n";
+                    continue;
+                }
+
+                std::vector<std::string> workerArguments = arguments;
+                workerArguments.push_back("--worker-fd");
+                workerArguments.push_back(std::to_string(fds[1]));
+                if (!threadsPerWorker.empty()) {
+                    workerArguments.push_back("--threads");
+                    workerArguments.push_back(threadsPerWorker);
+                }
+                // Only the first worker crashes, so the others have to pick up its tiles
+                if (w == 0 && crashAfterTiles >= 0) {
+                    workerArguments.push_back("--crash-worker-after");
+                    workerArguments.push_back(std::to_string(crashAfterTiles));
+                }
+
+                pid_t pid = fork();
+                if (pid == 0) {
+                    // The worker's end stays open across exec, the coordinator's ends of every pair close
+                    fcntl(fds[1], F_SETFD, 0);
+                    std::vector<char*> argv;
+                    argv.push_back(const_cast<char*>(program.c_str()));
+                    for (const std::string& argument : workerArguments) {
+                        argv.push_back(const_cast<char*>(argument.c_str()));
+                    }
+                    argv.push_back(nullptr);
+#if defined(__linux__)
+                    execv("/proc/self/exe", argv.data());
+#endif
+                    execvp(program.c_str(), argv.data());
+                    _exit(127);
+                }
+                close(fds[1]);
+                if (pid < 0) {
+                    std::cerr << "Can't start worker " << w << ": " << std::strerror(errno) << "\n";
+                    close(fds[0]);
+                    continue;
+                }
+
+                Worker worker;
+                worker.fd = fds[0];
+                worker.pid = pid;
+                worker.alive = true;
+                mWorkers.push_back(worker);
+            }
+
+            int ready = 0;
+            for (Worker& worker : mWorkers) {
+                MessageType type;
+                std::vector<char> payload;
+                HelloMessage hello;
+                if (ReceiveMessage(worker.fd, type, payload) && type == MessageType::Hello && ReadBytes(payload, 0, hello)) {
+                    worker.threads = std::max(1, hello.threads);
+                    ready++;
+                }
+                else {
+                    Lose(worker, nullptr);
+                }
+            }
+            return ready > 0;
+        }
+
+        int LiveWorkers() const {
+            return static_cast<int>(std::count_if(mWorkers.begin(), mWorkers.end(), [](const Worker& worker) { return worker.alive; }));
+        }
+
+        const PathCounters& LastPathCounters() const { return mPathCounters; }
+        const AdaptiveStats& LastAdaptiveStats() const { return mAdaptiveStats; }
+
+        // Same result and tile statistics as renderer.Render() for job of the list the workers were started with,
+        // renderer, world and cam being the coordinator's own, ready for that job (used once no worker is left)
+        // rowsCompleted(y0, y1) is called like TileRenderer::OnRowsCompleted() as tiles come back
+        std::vector<TileStats> Render(int job, TileRenderer& renderer, const Hittable& world, const Camera& cam, Framebuffer& framebuffer,
+                                      const std::function<void(int, int)>& rowsCompleted = nullptr) {
+            const RenderSettings& settings = renderer.Settings();
+            std::vector<Tile> tiles = renderer.MakeTiles();
+            std::vector<TileStats> stats(tiles.size());
+            std::vector<char> received(tiles.size(), 0);
+            size_t receivedCount = 0;
+            std::deque<int> pending;
+            for (size_t i = 0; i < tiles.size(); i++) {
+                pending.push_back(static_cast<int>(i));
+            }
+            framebuffer.Clear();
+            mPathCounters = PathCounters();
+            mAdaptiveStats = AdaptiveStats();
+
+            int tileSize = std::max(1, settings.tileSize);
+            int tilesPerRow = (settings.imageWidth + tileSize - 1) / tileSize;
+            std::vector<int> tilesLeft((settings.imageHeight + tileSize - 1) / tileSize, tilesPerRow);
+            size_t nextRow = 0;
+
+            auto tileDone = [&](int index, double milliseconds) {
+                received[index] = 1;
+                receivedCount++;
+                stats[index] = { tiles[index], milliseconds };
+                tilesLeft[tiles[index].y0 / tileSize]--;
+                while (nextRow < tilesLeft.size() && tilesLeft[nextRow] == 0) {
+                    if (rowsCompleted) {
+                        rowsCompleted(static_cast<int>(nextRow) * tileSize, std::min(static_cast<int>(nextRow + 1) * tileSize, settings.imageHeight));
+                    }
+                    nextRow++;
+                }
+                std::cerr << "\rTiles remaining: " << tiles.size() - receivedCount << " (" << LiveWorkers() << " workers) " << std::flush;
+            };
+
+            // A batch keeps every thread of the worker busy, smaller towards the end so the workers finish together
+            auto assign = [&](Worker& worker) {
+                if (!worker.alive || !worker.inFlight.empty() || pending.empty()) {
+                    return;
+                }
+                size_t share = (pending.size() + LiveWorkers() - 1) / LiveWorkers();
+                size_t count = std::max<size_t>(1, std::min<size_t>(2 * worker.threads, share));
+
+                std::vector<char> payload;
+                AppendBytes(payload, RenderTilesMessage{ job, static_cast<int32_t>(std::min(count, pending.size())) });
+                while (count-- > 0 && !pending.empty()) {
+                    AppendBytes(payload, static_cast<int32_t>(pending.front()));
+                    worker.inFlight.push_back(pending.front());
+                    pending.pop_front();
+                }
+                if (!SendMessage(worker.fd, MessageType::RenderTiles, payload)) {
+                    Lose(worker, &pending);
+                }
+            };
+
+            std::vector<pollfd> polls;
+            std::vector<Worker*> polled;
+            std::vector<char> payload;
+            while (receivedCount < tiles.size()) {
+                for (Worker& worker : mWorkers) {
+                    assign(worker);
+                }
+
+                polls.clear();
+                polled.clear();
+                for (Worker& worker : mWorkers) {
+                    if (worker.alive && !worker.inFlight.empty()) {
+                        polls.push_back({ worker.fd, POLLIN, 0 });
+                        polled.push_back(&worker);
+                    }
+                }
+                if (polls.empty()) {
+                    break;
+                }
+                if (poll(polls.data(), polls.size(), -1) < 0) {
+                    if (errno == EINTR) continue;
+                    break;
+                }
+
+                for (size_t p = 0; p < polls.size(); p++) {
+                    if (polls[p].revents == 0) {
+                        continue;
+                    }
+                    Worker& worker = *polled[p];
+                    MessageType type;
+                    if (!ReceiveMessage(worker.fd, type, payload)) {
+                        Lose(worker, &pending);
+                        continue;
+                    }
+
+                    // Anything unexpected (truncated, of the wrong size, for another job or a tile outside the batch)
+                    // means the worker can't be trusted: it is dropped and its batch rendered again
+                    if (type == MessageType::TileResult) {
+                        TileResultMessage result;
+                        if (!ReadBytes(payload, 0, result) || result.job != job
+                            || std::find(worker.inFlight.begin(), worker.inFlight.end(), result.tile) == worker.inFlight.end()) {
+                            Lose(worker, &pending);
+                            continue;
+                        }
+                        const Tile& tile = tiles[result.tile];
+                        size_t pixelCount = static_cast<size_t>(tile.x1 - tile.x0) * (tile.y1 - tile.y0);
+                        if (payload.size() != sizeof(TileResultMessage) + pixelCount * sizeof(PixelResult)) {
+                            Lose(worker, &pending);
+                            continue;
+                        }
+
+                        // The pixels are the same whoever renders the tile, merging them before the batch is done is
+                        // harmless if the worker dies and the tile is rendered again
+                        size_t offset = sizeof(TileResultMessage);
+                        for (int y = tile.y0; y < tile.y1; y++) {
+                            for (int x = tile.x0; x < tile.x1; x++, offset += sizeof(PixelResult)) {
+                                PixelResult pixel;
+                                ReadBytes(payload, offset, pixel);
+                                framebuffer.At(x, y) = Vec3(Real(pixel.color[0]), Real(pixel.color[1]), Real(pixel.color[2]));
+                                framebuffer.SetSampleCount(x, y, pixel.samples);
+                            }
+                        }
+                        worker.results.push_back(std::make_pair(result.tile, result.milliseconds));
+                    }
+                    else if (type == MessageType::BatchDone) {
+                        // Every tile of the batch must be in before it is done
+                        BatchDoneMessage done;
+                        if (payload.size() != sizeof(BatchDoneMessage) || !ReadBytes(payload, 0, done) || worker.results.size() != worker.inFlight.size()) {
+                            Lose(worker, &pending);
+                            continue;
+                        }
+                        mPathCounters.Merge(done.paths);
+                        mAdaptiveStats.Merge(done.adaptive);
+                        for (const std::pair<int, double>& result : worker.results) {
+                            if (!received[result.first]) {
+                                worker.tilesRendered++;
+                                tileDone(result.first, result.second);
+                            }
+                        }
+                        worker.inFlight.clear();
+                        worker.results.clear();
+                    }
+                    else {
+                        Lose(worker, &pending);
+                    }
+                }
+            }
+
+            // No worker left: the coordinator finishes the frame itself
+            std::vector<Tile> remaining;
+            std::vector<int> remainingIndices;
+            for (size_t i = 0; i < tiles.size(); i++) {
+                if (!received[i]) {
+                    remaining.push_back(tiles[i]);
+                    remainingIndices.push_back(static_cast<int>(i));
+                }
+            }
+            if (!remaining.empty()) {
+                std::cerr << "\rNo worker left, rendering the last " << remaining.size() << " tiles locally\n";
+                Framebuffer local(settings.imageWidth, settings.imageHeight);
+                std::vector<TileStats> localStats = renderer.RenderTiles(world, cam, local, remaining, 0, settings.samplesPerPixel);
+                for (size_t i = 0; i < remaining.size(); i++) {
+                    const Tile& tile = remaining[i];
+                    for (int y = tile.y0; y < tile.y1; y++) {
+                        for (int x = tile.x0; x < tile.x1; x++) {
+                            framebuffer.At(x, y) = local.At(x, y);
+                            framebuffer.SetSampleCount(x, y, local.SampleCount(x, y));
+                        }
+                    }
+                    tileDone(remainingIndices[i], localStats[i].milliseconds);
+                }
+                mTilesRenderedLocally += remaining.size();
+                mPathCounters.Merge(renderer.LastPathCounters());
+                mAdaptiveStats.Merge(renderer.LastAdaptiveStats());
+            }
+
+            return stats;
+        }
+
+        void PrintReport(std::ostream& out) const {
+            out << "Workers: " << LiveWorkers() << " of " << mWorkers.size() << " alive, " << mWorkersLost << " lost, "
+                << mTilesReassigned << " tiles reassigned, " << mTilesRenderedLocally << " rendered by the coordinator\n";
+            for (const Worker& worker : mWorkers) {
+                out << "  worker " << worker.pid << ": " << worker.threads << " threads, " << worker.tilesRendered << " tiles"
+                    << (worker.alive ? "" : " (lost)") << "\n";
+            }
+        }
+
+    private:
+        // The worker is gone (or unusable): every tile of its open batch goes back to the front of pending, the ones it
+        // already sent too since their path counters were never received
+        void Lose(Worker& worker, std::deque<int>* pending) {
+            worker.alive = false;
+            close(worker.fd);
+            // It may still be running when only its socket failed
+            kill(worker.pid, SIGKILL);
+            waitpid(worker.pid, nullptr, 0);
+            mWorkersLost++;
+
+            if (pending) {
+                pending->insert(pending->begin(), worker.inFlight.begin(), worker.inFlight.end());
+                mTilesReassigned += worker.inFlight.size();
+                std::cerr << "\rWorker " << worker.pid << " lost, " << worker.inFlight.size() << " tiles reassigned\n";
+            }
+            worker.inFlight.clear();
+            worker.results.clear();
+        }
+};
+
+#else
+
+// Sockets and processes are only written for POSIX systems, elsewhere every frame renders in the one process
+int RunWorker(int, TileRenderer&, const Hittable&, const std::function<Camera(int)>&, int = -1) {
+    std::cerr << "Workers need a POSIX system.\n";
+    return 1;
+}
+
+class TileCoordinator {
+    public:
+        bool Start(int, const std::string&, const std::vector<std::string>&, int = -1) {
+            std::cerr << "Distributed rendering needs a POSIX system, rendering locally.\n";
+            return false;
+        }
+        const PathCounters& LastPathCounters() const { return mPathCounters; }
+        const AdaptiveStats& LastAdaptiveStats() const { return mAdaptiveStats; }
+        std::vector<TileStats> Render(int, TileRenderer& renderer, const Hittable& world, const Camera& cam, Framebuffer& framebuffer,
+                                      const std::function<void(int, int)>& = nullptr) {
+            return renderer.Render(world, cam, framebuffer);
+        }
+        void PrintReport(std::ostream&) const {}
+
+    private:
+        PathCounters mPathCounters;
+        AdaptiveStats mAdaptiveStats;
+};
+
+#endif //RAYTRACER_DISTRIBUTED
+
+#endif //DISTRIBUTED_H
@@ -0,0 +1,205 @@
+#ifndef EXAMPLE_SCENES_H
+#define EXAMPLE_SCENES_H
+
+#include <cmath>
+#include <vector>
+
+#include "Instance.h"
+#include "Material.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "SphereBatch.h"
+#include "Utility.h"
+
+// The scene rendered by default: ground, diffuse, hollow glass and metal spheres
+Scene ThreeSpheresScene() {
+    #pragma region PREVIOUS VERSION
+    /*
+    HittableList world;
+
+    shared_ptr<Lambertian> materialGround = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0));
+    shared_ptr<Lambertian> materialCenter = make_shared<Lambertian>(Vec3(0.7, 0.3, 0.3));
+    shared_ptr<Dieletric> materialLeft = make_shared<Dieletric>(1.5);
+    shared_ptr<Metal> materialRight = make_shared<Metal>(Vec3(0.8, 0.6, 0.2), 0.2);
+
+    world.Add(make_shared<Sphere>(Vec3(0.0, -100.5, -1.0), 100.0, materialGround));
+    world.Add(make_shared<Sphere>(Vec3(0.0, 0.0, -1.0), 0.5, materialCenter));
+    world.Add(make_shared<Sphere>(Vec3(-1.0, 0.0, -1.0), 0.5, materialLeft));
+    world.Add(make_shared<Sphere>(Vec3(-1.0, 0.0, -1.0), -0.4, materialLeft));
+    world.Add(make_shared<Sphere>(Vec3(1.0, 0.0, -1.0), 0.5, materialRight));
+    */
+    #pragma endregion
+    #pragma region MORE RECENT VERSION
+    
+    double radius = cos(pi/4);
+    Scene scene;
+
+    Lambertian* materialGround = scene.MakeMaterial<Lambertian>(Vec3(0.8, 0.8, 0.0));
+    Lambertian* materialCenter = scene.MakeMaterial<Lambertian>(Vec3(0.1, 0.2, 0.5));
+    Dielectric* materialLeft = scene.MakeMaterial<Dielectric>(1.5);
+    Metal* materialRight = scene.MakeMaterial<Metal>(Vec3(0.8, 0.6, 0.2), 0.0);
+
+    scene.Add<Sphere>(Vec3( 0.0, -100.5, -1.0), 100.0, materialGround);
+    scene.Add<Sphere>(Vec3( 0.0,    0.0, -1.0),   0.5, materialCenter);
+    scene.Add<Sphere>(Vec3(-1.0,    0.0, -1.0),   0.5, materialLeft);
+    scene.Add<Sphere>(Vec3(-1.0,    0.0, -1.0), -0.45, materialLeft);
+    scene.Add<Sphere>(Vec3( 1.0,    0.0, -1.0),   0.5, materialRight);
+    
+    #pragma endregion
+
+    return scene;
+}
+
+// The three spheres in the dark and all diffuse, lit by two small emitting spheres: one warm above them, one cold and
+// dimmer in front. Render it with no sky (skyIntensity 0), the paths have to find lights covering a few thousandths
+// of their sky. No mirror nor glass: their caustics can only be found by bouncing, whatever the light sampling
+Scene SmallLightScene() {
+    Scene scene;
+
+    Lambertian* materialGround = scene.MakeMaterial<Lambertian>(Vec3(0.8, 0.8, 0.0));
+    Lambertian* materialCenter = scene.MakeMaterial<Lambertian>(Vec3(0.1, 0.2, 0.5));
+    Lambertian* materialLeft = scene.MakeMaterial<Lambertian>(Vec3(0.8, 0.8, 0.8));
+    Lambertian* materialRight = scene.MakeMaterial<Lambertian>(Vec3(0.8, 0.6, 0.2));
+    DiffuseLight* warmLight = scene.MakeMaterial<DiffuseLight>(Vec3(320.0, 280.0, 220.0));
+    DiffuseLight* coldLight = scene.MakeMaterial<DiffuseLight>(Vec3(20.0, 30.0, 60.0));
+
+    scene.Add<Sphere>(Vec3( 0.0, -100.5, -1.0), 100.0, materialGround);
+    scene.Add<Sphere>(Vec3( 0.0,    0.0, -1.0),   0.5, materialCenter);
+    scene.Add<Sphere>(Vec3(-1.0,    0.0, -1.0),   0.5, materialLeft);
+    scene.Add<Sphere>(Vec3( 1.0,    0.0, -1.0),   0.5, materialRight);
+    scene.Add<Sphere>(Vec3( 0.3,    1.8, -0.6),   0.1, warmLight);
+    scene.Add<Sphere>(Vec3( 1.5,    0.2,  0.8),  0.08, coldLight);
+
+    return scene;
+}
+
+Scene RandomScene() {
+    Scene scene;
+
+    Lambertian* groundMaterial = scene.MakeMaterial<Lambertian>(Vec3(0.5, 0.5, 0.5));
+    scene.Add<Sphere>(Vec3(0.0, -1000, 0.0), 1000.0, groundMaterial);
+
+    for (int i = -11; i < 11; i++)
+    {
+        for (int j = -11; j < 11; j++)
+        {
+            double chooseMat = RandomDouble();
+            Vec3 center(i + 0.9*RandomDouble(), 0.2, j + 0.9*RandomDouble());
+
+            if ((center - Vec3(4.0, 0.2, 0.0)).length() > 0.9) {
+                const Material* sphereMaterial;
+
+                if (chooseMat < 0.8) {
+                    // Diffuse 
+                    Vec3 albedo = Vec3::Random() * Vec3::Random();
+                    sphereMaterial = scene.MakeMaterial<Lambertian>(albedo);
+                    scene.Add<Sphere>(center, 0.2, sphereMaterial);
+                }
+                else if (chooseMat < 0.95) {
+                    // Metal
+                    Vec3 albedo = Vec3::Random(0.5, 1.0);
+                    double fuzzyness = RandomDouble(0.0, 0.5);
+                    sphereMaterial = scene.MakeMaterial<Metal>(albedo, fuzzyness);
+                    scene.Add<Sphere>(center, 0.2, sphereMaterial);
+                }
+                else {
+                    // Glass
+                    sphereMaterial = scene.MakeMaterial<Dielectric>(1.5);
+                    scene.Add<Sphere>(center, 0.2, sphereMaterial);
+                }
+            }
+        }
+    }
+    
+    Dielectric* dielectricExampleMaterial = scene.MakeMaterial<Dielectric>(1.5);
+    scene.Add<Sphere>(Vec3(0.0, 1.0, 0.0), 1.0, dielectricExampleMaterial);
+    Lambertian* lambertianExampleMaterial = scene.MakeMaterial<Lambertian>(Vec3(0.4, 0.2, 0.1));
+    scene.Add<Sphere>(Vec3(-4.0, 1.0, 0.0), 1.0, lambertianExampleMaterial);
+    Metal* metalExampleMaterial = scene.MakeMaterial<Metal>(Vec3(0.7, 0.6, 0.5), 0.0);
+    scene.Add<Sphere>(Vec3(4.0, 1.0, 0.0), 1.0, metalExampleMaterial);
+
+    return scene;
+}
+
+// instanceCount small sphere groups (a ball, a snowman, a cluster) scattered over a ground sphere, one per unit of
+// area, each turned about the vertical and scaled. With instanced, every group is an instance of one of three
+// prototype BVHs under an InstanceBvh; otherwise every sphere of every group is its own Sphere the way RandomScene()
+// builds them. Both give the same image
+Scene InstancedScene(size_t instanceCount, bool instanced = true) {
+    Scene scene;
+    SeedRandom(0, 2);
+
+    const Real groundRadius = 1000;
+    Lambertian* groundMaterial = scene.MakeMaterial<Lambertian>(Vec3(0.5, 0.5, 0.5));
+    scene.Add<Sphere>(Vec3(0, -groundRadius, 0), groundRadius, groundMaterial);
+
+    // Colors the instances pick from, instead of a material per sphere
+    std::vector<const Material*> palette;
+    for (int i = 0; i < 12; i++) {
+        palette.push_back(scene.MakeMaterial<Lambertian>(Vec3::Random() * Vec3::Random()));
+    }
+    for (int i = 0; i < 3; i++) {
+        palette.push_back(scene.MakeMaterial<Metal>(Vec3::Random(0.5, 1.0), RandomDouble(0.0, 0.3)));
+    }
+    palette.push_back(scene.MakeMaterial<Dielectric>(1.5));
+
+    // Groups standing on y = 0, the cluster keeps its own materials, the others take one from the palette
+    struct GroupSphere { Vec3 center; Real radius; const Material* material; };
+    const Material* core = scene.MakeMaterial<Metal>(Vec3(0.8, 0.8, 0.9), 0.05);
+    const Material* satellite = scene.MakeMaterial<Lambertian>(Vec3(0.7, 0.2, 0.1));
+    const std::vector<std::vector<GroupSphere>> groups = {
+        { { Vec3(0, 1, 0), 1, palette[0] } },
+        { { Vec3(0, 0.6, 0), 0.6, palette[0] }, { Vec3(0, 1.5, 0), 0.4, palette[0] }, { Vec3(0, 2.1, 0), 0.25, palette[0] } },
+        { { Vec3(0, 0.8, 0), 0.5, core }, { Vec3(0.7, 0.35, 0), 0.35, satellite }, { Vec3(-0.7, 0.35, 0), 0.35, satellite },
+          { Vec3(0, 0.35, 0.7), 0.35, satellite }, { Vec3(0, 0.35, -0.7), 0.35, satellite } },
+    };
+
+    InstanceBatch instances;
+    std::vector<uint32_t> paletteIndex;
+    if (instanced) {
+        for (const auto& group : groups) {
+            SphereBatch spheres;
+            for (const GroupSphere& sphere : group) {
+                spheres.Add(sphere.center, sphere.radius, sphere.material);
+            }
+            instances.AddPrototype(scene.Storage().Make<SphereBvh>(spheres));
+        }
+        for (const Material* material : palette) {
+            paletteIndex.push_back(instances.AddMaterial(material));
+        }
+        instances.Reserve(instanceCount);
+    }
+
+    // Jittered grid cells of one unit around the origin
+    size_t side = static_cast<size_t>(std::ceil(std::sqrt(double(instanceCount))));
+    Real half = Real(0.5) * side;
+    for (size_t i = 0; i < instanceCount; i++) {
+        Real x = Real(i % side) - half + Real(RandomDouble(0.15, 0.85));
+        Real z = Real(i / side) - half + Real(RandomDouble(0.15, 0.85));
+        // On the ground's surface
+        Real y = std::sqrt(groundRadius * groundRadius - x * x - z * z) - groundRadius;
+        Real scale = Real(RandomDouble(0.12, 0.25));
+        double angle = RandomDouble(0.0, 360.0);
+        double chooseGroup = RandomDouble();
+        uint32_t group = chooseGroup < 0.6 ? 0 : chooseGroup < 0.85 ? 1 : 2;
+        uint32_t color = static_cast<uint32_t>(RandomDouble() * palette.size());
+
+        AffineTransform objectToWorld = AffineTransform::Translate(Vec3(x, y, z)) * AffineTransform::Rotate(Vec3(0, 1, 0), angle)
+                                      * AffineTransform::Scale(scale);
+        if (instanced) {
+            instances.Add(group, objectToWorld, group == 2 ? uint32_t(InstanceBatch::noMaterial) : paletteIndex[color]);
+        }
+        else {
+            for (const GroupSphere& sphere : groups[group]) {
+                scene.Add<Sphere>(objectToWorld.Point(sphere.center), scale * sphere.radius, group == 2 ? sphere.material : palette[color]);
+            }
+        }
+    }
+
+    if (instanced) {
+        scene.Add<InstanceBvh>(instances);
+    }
+    return scene;
+}
+
+#endif //EXAMPLE_SCENES_H
@@ -0,0 +1,580 @@
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Bvh.h"
+
+// 32 bytes, two nodes per cache line
+struct FlatBvhNode {
+    float boundsMin[3];
+    float boundsMax[3];
+    // Leaf -> index of the first primitive, interior -> index of the second child (the first child directly follows its parent)
+    uint32_t offset;
+    // 0 for interior nodes
+    uint16_t primitiveCount;
+    // Split axis of interior nodes, used to visit the nearest child first
+    uint8_t axis;
+    uint8_t pad;
+};
+
+static_assert(sizeof(FlatBvhNode) == 32, "FlatBvhNode must stay 32 bytes");
+
+// Traversal counters, every thread increments its own block and blocks are only summed once rendering is over
+struct BvhTraversalCounters {
+    uint64_t rays = 0;
+    uint64_t nodesVisited = 0;
+    // Primitives of the leaves whose box was hit, each one an intersection test
+    uint64_t primitivesTested = 0;
+};
+
+class BvhTraversalRegistry {
+    private:
+        std::mutex mMutex;
+        // Blocks outlive their thread so the counts of joined threads are kept
+        std::vector<std::unique_ptr<BvhTraversalCounters>> mBlocks;
+
+    public:
+        static BvhTraversalRegistry& Instance() {
+            static BvhTraversalRegistry registry;
+            return registry;
+        }
+
+        static BvhTraversalCounters& Local() {
+            thread_local BvhTraversalCounters* counters = Instance().NewBlock();
+            return *counters;
+        }
+
+        BvhTraversalCounters* NewBlock() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBlocks.emplace_back(new BvhTraversalCounters());
+            return mBlocks.back().get();
+        }
+
+        // Not synchronized with running traversals, call it when no thread is tracing
+        BvhTraversalCounters Total() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            BvhTraversalCounters total;
+            for (const auto& block : mBlocks) {
+                total.rays += block->rays;
+                total.nodesVisited += block->nodesVisited;
+                total.primitivesTested += block->primitivesTested;
+            }
+            return total;
+        }
+
+        void Reset() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (const auto& block : mBlocks) {
+                *block = BvhTraversalCounters();
+            }
+        }
+};
+
+// Default leaf storage of FlatBvh: the primitives in leaf order, reached through raw pointers while tracing
+class HittableLeaves {
+    public:
+        static const int maxLeafSize = 4;
+
+    private:
+        // Keeps the primitives alive
+        std::vector<shared_ptr<Hittable>> mPrimitives;
+        std::vector<const Hittable*> mRawPrimitives;
+
+    public:
+        HittableLeaves() {}
+        HittableLeaves(const std::vector<shared_ptr<Hittable>>& orderedObjects) : mPrimitives(orderedObjects) {
+            mRawPrimitives.reserve(orderedObjects.size());
+            for (const auto& object : orderedObjects) {
+                mRawPrimitives.push_back(object.get());
+            }
+        }
+
+        size_t Size() const { return mRawPrimitives.size(); }
+
+        // Any object will do
+        static bool CanHold(const std::vector<shared_ptr<Hittable>>&) { return true; }
+
+        size_t MemoryFootprint() const { return mRawPrimitives.size() * sizeof(const Hittable*); }
+
+        // Nearest hit among the primitives [first, first + count[
+        bool HitRange(const Ray& r, size_t first, size_t count, Real tMin, Real tMax, HitRecord& rec) const {
+            bool hitAnything = false;
+            for (size_t i = first; i < first + count; i++) {
+                if (mRawPrimitives[i]->Hit(r, tMin, tMax, rec)) {
+                    hitAnything = true;
+                    tMax = rec.t;
+                }
+            }
+            return hitAnything;
+        }
+};
+
+// Same hierarchy as BvhNode, linearised depth first into one contiguous array and traversed with a small stack
+// LeafStorage holds the primitives in leaf order, it is built from the reordered objects and exposes HitRange()
+// Built from a list, LeafStorage::CanHold(objects) tells whether it takes every object: the tree stays empty otherwise
+template <typename LeafStorage>
+class FlatBvhT : public Hittable {
+    public:
+        static const int maxLeafSize = LeafStorage::maxLeafSize;
+        static const int stackSize = 64;
+        // Below this depth nodes are split in halves, which keeps the depth (and the traversal stack) under stackSize
+        static const int maxSahDepth = 32;
+
+    private:
+        std::vector<FlatBvhNode> mNodes;
+        LeafStorage mLeaves;
+        // Leaf position of every primitive, in the order of the list or storage the BVH was built from
+        std::vector<uint32_t> mLeafIndex;
+        double mBuildMilliseconds = 0.0;
+        int mMaxDepth = 0;
+
+        struct PrimitiveInfo {
+            size_t index;
+            Aabb box;
+        };
+
+    public:
+        FlatBvhT() {}
+        FlatBvhT(const HittableList& list) {
+            auto start = std::chrono::steady_clock::now();
+            Build(list.objects);
+            mBuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        // Straight from leaf storage already holding the primitives (a SphereBatch loaded from a scene file), which
+        // needs Box(i) and Reordered(order) on top of the usual interface
+        explicit FlatBvhT(const LeafStorage& primitives) {
+            auto start = std::chrono::steady_clock::now();
+
+            std::vector<PrimitiveInfo> infos(primitives.Size());
+            for (size_t i = 0; i < infos.size(); i++) {
+                infos[i] = { i, primitives.Box(i) };
+            }
+            BuildNodes(infos);
+
+            std::vector<size_t> order(infos.size());
+            for (size_t i = 0; i < infos.size(); i++) {
+                order[i] = infos[i].index;
+            }
+            mLeaves = primitives.Reordered(order);
+            IndexLeaves(infos);
+
+            mBuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        size_t NodeCount() const { return mNodes.size(); }
+        size_t PrimitiveCount() const { return mLeaves.Size(); }
+        int MaxDepth() const { return mMaxDepth; }
+        double BuildMilliseconds() const { return mBuildMilliseconds; }
+
+        const LeafStorage& Leaves() const { return mLeaves; }
+
+        // For animation: primitives are moved in place in the leaves, then Refit() updates the boxes
+        LeafStorage& MutableLeaves() { return mLeaves; }
+
+        // Leaf position of primitive i of the list or storage the BVH was built from
+        size_t LeafIndex(size_t primitive) const { return mLeafIndex[primitive]; }
+
+        // Recomputes every box from the leaves up after primitives moved, LeafStorage must provide Box(i)
+        // The tree is kept: a single linear pass, far cheaper than a rebuild, but boxes grow looser as the primitives
+        // drift away from where the tree was built (SahCost() tells how much)
+        void Refit() {
+            // Children come after their parent in depth first order, so walking backwards visits them first
+            for (size_t n = mNodes.size(); n-- > 0;) {
+                FlatBvhNode& node = mNodes[n];
+                Aabb bounds;
+                if (node.primitiveCount > 0) {
+                    for (size_t i = node.offset; i < node.offset + node.primitiveCount; i++) {
+                        bounds.Grow(mLeaves.Box(i));
+                    }
+                }
+                else {
+                    bounds = NodeBox(mNodes[n + 1]);
+                    bounds.Grow(NodeBox(mNodes[node.offset]));
+                }
+                for (int a = 0; a < 3; a++) {
+                    node.boundsMin[a] = bounds.min()[a];
+                    node.boundsMax[a] = bounds.max()[a];
+                }
+            }
+        }
+
+        // Expected cost of a ray through the tree with the costs of BuildRecursive(), relative to the root box:
+        // comparing it after refits with its value after a rebuild shows how much the tree degraded
+        double SahCost() const {
+            if (mNodes.empty()) {
+                return 0.0;
+            }
+
+            double cost = 0.0;
+            for (const FlatBvhNode& node : mNodes) {
+                double area = NodeBox(node).SurfaceArea();
+                cost += node.primitiveCount > 0 ? node.primitiveCount * area : area;
+            }
+            double rootArea = NodeBox(mNodes[0]).SurfaceArea();
+            return rootArea > 0.0 ? cost / rootArea : 0.0;
+        }
+
+        // Bytes touched while tracing: the nodes plus the leaf storage
+        size_t MemoryFootprint() const {
+            return mNodes.size() * sizeof(FlatBvhNode) + mLeaves.MemoryFootprint();
+        }
+
+        virtual bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const override {
+            if (mNodes.empty()) {
+                return false;
+            }
+
+            Vec3 origin = r.origin();
+            Vec3 direction = r.direction();
+            // Boxes are tested in float whatever Real is
+            float invDir[3] = { static_cast<float>(1 / direction.x()), static_cast<float>(1 / direction.y()), static_cast<float>(1 / direction.z()) };
+            bool dirIsNeg[3] = { invDir[0] < 0.0f, invDir[1] < 0.0f, invDir[2] < 0.0f };
+
+            uint32_t stack[stackSize];
+            int stackTop = 0;
+            uint32_t current = 0;
+            bool hitAnything = false;
+            uint64_t visited = 0;
+            uint64_t tested = 0;
+
+            while (true) {
+                const FlatBvhNode& node = mNodes[current];
+                visited++;
+
+                if (HitBox(node, origin, invDir, tMin, tMax)) {
+                    if (node.primitiveCount > 0) {
+                        tested += node.primitiveCount;
+                        if (mLeaves.HitRange(r, node.offset, node.primitiveCount, tMin, tMax, rec)) {
+                            hitAnything = true;
+                            tMax = rec.t;
+                        }
+                        if (stackTop == 0) break;
+                        current = stack[--stackTop];
+                    }
+                    else if (dirIsNeg[node.axis]) {
+                        // The ray goes towards the second child's side, visit it first
+                        stack[stackTop++] = current + 1;
+                        current = node.offset;
+                    }
+                    else {
+                        stack[stackTop++] = node.offset;
+                        current = current + 1;
+                    }
+                }
+                else {
+                    if (stackTop == 0) break;
+                    current = stack[--stackTop];
+                }
+            }
+
+            BvhTraversalCounters& counters = BvhTraversalRegistry::Local();
+            counters.rays++;
+            counters.nodesVisited += visited;
+            counters.primitivesTested += tested;
+
+            return hitAnything;
+        }
+
+        // Coherent packets are culled as a whole with interval arithmetic, leaves are still tested ray by ray
+        virtual void HitPacket(const RayPacket& packet, Real tMin, Real tMax, HitRecord* recs, bool* hits) const override {
+            int count = packet.count;
+            float rayTMax[RayPacket::maxSize];
+            float invDirs[RayPacket::maxSize][3];
+            Vec3 origins[RayPacket::maxSize];
+
+            for (int i = 0; i < count; i++) {
+                hits[i] = false;
+                rayTMax[i] = static_cast<float>(tMax);
+                origins[i] = packet.rays[i].origin();
+                Vec3 direction = packet.rays[i].direction();
+                for (int a = 0; a < 3; a++) {
+                    invDirs[i][a] = static_cast<float>(1 / direction[a]);
+                }
+            }
+
+            if (mNodes.empty() || count == 0) {
+                return;
+            }
+
+            // Bounds of the origins and inverse directions over the packet, only usable when all directions share their signs
+            float originMin[3], originMax[3], invDirMin[3], invDirMax[3];
+            bool coherent = true;
+            for (int a = 0; a < 3; a++) {
+                originMin[a] = originMax[a] = origins[0][a];
+                invDirMin[a] = invDirMax[a] = invDirs[0][a];
+                bool negative = invDirs[0][a] < 0.0f;
+                for (int i = 1; i < count; i++) {
+                    originMin[a] = std::min(originMin[a], static_cast<float>(origins[i][a]));
+                    originMax[a] = std::max(originMax[a], static_cast<float>(origins[i][a]));
+                    invDirMin[a] = std::min(invDirMin[a], invDirs[i][a]);
+                    invDirMax[a] = std::max(invDirMax[a], invDirs[i][a]);
+                    coherent = coherent && ((invDirs[i][a] < 0.0f) == negative);
+                }
+            }
+
+            // Every stack entry remembers the first ray of the packet known to reach the node, the rays before it are skipped
+            uint32_t stack[stackSize];
+            int firstActiveStack[stackSize];
+            int stackTop = 0;
+            uint32_t current = 0;
+            int firstActive = 0;
+            uint64_t visited = 0;
+            uint64_t tested = 0;
+
+            while (true) {
+                const FlatBvhNode& node = mNodes[current];
+                visited++;
+
+                float packetTMax = rayTMax[firstActive];
+                for (int i = firstActive + 1; i < count; i++) {
+                    packetTMax = std::max(packetTMax, rayTMax[i]);
+                }
+
+                // Quick reject of the whole packet, then look for the first ray that really crosses the box
+                int first = count;
+                if (!coherent || HitBoxInterval(node, originMin, originMax, invDirMin, invDirMax, tMin, packetTMax)) {
+                    for (first = firstActive; first < count; first++) {
+                        if (HitBox(node, origins[first], invDirs[first], tMin, rayTMax[first])) {
+                            break;
+                        }
+                    }
+                }
+
+                if (first < count && node.primitiveCount > 0) {
+                    for (int i = first; i < count; i++) {
+                        if (i != first && !HitBox(node, origins[i], invDirs[i], tMin, rayTMax[i])) {
+                            continue;
+                        }
+                        tested += node.primitiveCount;
+                        if (mLeaves.HitRange(packet.rays[i], node.offset, node.primitiveCount, tMin, rayTMax[i], recs[i])) {
+                            hits[i] = true;
+                            rayTMax[i] = static_cast<float>(recs[i].t);
+                        }
+                    }
+                }
+                else if (first < count) {
+                    // The first active ray orders the children for the whole packet
+                    firstActiveStack[stackTop] = first;
+                    if (invDirs[first][node.axis] < 0.0f) {
+                        stack[stackTop++] = current + 1;
+                        current = node.offset;
+                    }
+                    else {
+                        stack[stackTop++] = node.offset;
+                        current = current + 1;
+                    }
+                    firstActive = first;
+                    continue;
+                }
+
+                if (stackTop == 0) break;
+                --stackTop;
+                current = stack[stackTop];
+                firstActive = firstActiveStack[stackTop];
+            }
+
+            BvhTraversalCounters& counters = BvhTraversalRegistry::Local();
+            counters.rays += count;
+            counters.nodesVisited += visited;
+            counters.primitivesTested += tested;
+        }
+
+        virtual bool BoundingBox(Aabb& outputBox) const override {
+            if (mNodes.empty()) {
+                return false;
+            }
+            const FlatBvhNode& root = mNodes[0];
+            outputBox = Aabb(Vec3(root.boundsMin[0], root.boundsMin[1], root.boundsMin[2]), Vec3(root.boundsMax[0], root.boundsMax[1], root.boundsMax[2]));
+            return true;
+        }
+
+    private:
+        // Conservative slab test for a whole packet: false only when no origin in [originMin, originMax] combined
+        // with no inverse direction in [invDirMin, invDirMax] can reach the box (all directions having the same signs)
+        static bool HitBoxInterval(const FlatBvhNode& node, const float originMin[3], const float originMax[3], const float invDirMin[3], const float invDirMax[3], Real tMin, float tMax) {
+            float enter = static_cast<float>(tMin);
+            float exit = tMax;
+            for (int a = 0; a < 3; a++) {
+                // Distances to both planes, as intervals over the packet
+                float lowMin = node.boundsMin[a] - originMax[a];
+                float lowMax = node.boundsMin[a] - originMin[a];
+                float highMin = node.boundsMax[a] - originMax[a];
+                float highMax = node.boundsMax[a] - originMin[a];
+
+                float tLowMin, tLowMax, tHighMin, tHighMax;
+                IntervalProduct(lowMin, lowMax, invDirMin[a], invDirMax[a], tLowMin, tLowMax);
+                IntervalProduct(highMin, highMax, invDirMin[a], invDirMax[a], tHighMin, tHighMax);
+
+                // Negative directions enter through the high plane
+                if (invDirMin[a] < 0.0f) {
+                    std::swap(tLowMin, tHighMin);
+                    std::swap(tLowMax, tHighMax);
+                }
+
+                // The earliest possible entry and latest possible exit over the packet
+                enter = std::max(enter, tLowMin);
+                exit = std::min(exit, tHighMax);
+                if (exit < enter) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static void IntervalProduct(float a0, float a1, float b0, float b1, float& lo, float& hi) {
+            float p0 = a0 * b0, p1 = a0 * b1, p2 = a1 * b0, p3 = a1 * b1;
+            lo = std::min(std::min(p0, p1), std::min(p2, p3));
+            hi = std::max(std::max(p0, p1), std::max(p2, p3));
+        }
+
+        static bool HitBox(const FlatBvhNode& node, const Vec3& origin, const float invDir[3], Real tMin, Real tMax) {
+            float t0 = static_cast<float>(tMin);
+            float t1 = static_cast<float>(tMax);
+            for (int a = 0; a < 3; a++) {
+                float tNear = (node.boundsMin[a] - origin[a]) * invDir[a];
+                float tFar = (node.boundsMax[a] - origin[a]) * invDir[a];
+                if (invDir[a] < 0.0f) {
+                    std::swap(tNear, tFar);
+                }
+                t0 = tNear > t0 ? tNear : t0;
+                t1 = tFar < t1 ? tFar : t1;
+                if (t1 < t0) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        static Aabb NodeBox(const FlatBvhNode& node) {
+            return Aabb(Vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]), Vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+        }
+
+        void IndexLeaves(const std::vector<PrimitiveInfo>& infos) {
+            mLeafIndex.resize(infos.size());
+            for (size_t i = 0; i < infos.size(); i++) {
+                mLeafIndex[infos[i].index] = static_cast<uint32_t>(i);
+            }
+        }
+
+        void Build(const std::vector<shared_ptr<Hittable>>& objects) {
+            if (objects.empty()) {
+                return;
+            }
+            // Leaves missing some of the objects would shift every leaf after them, no tree is better than that one
+            if (!LeafStorage::CanHold(objects)) {
+                std::cerr << "The leaves of this BVH can't hold every object of the list, BVH left empty.\n";
+                return;
+            }
+
+            std::vector<PrimitiveInfo> infos(objects.size());
+            for (size_t i = 0; i < objects.size(); i++) {
+                infos[i] = { i, BvhNode::BoxOf(objects[i]) };
+            }
+            BuildNodes(infos);
+
+            std::vector<shared_ptr<Hittable>> ordered;
+            ordered.reserve(objects.size());
+            for (const PrimitiveInfo& info : infos) {
+                ordered.push_back(objects[info.index]);
+            }
+            mLeaves = LeafStorage(ordered);
+            IndexLeaves(infos);
+        }
+
+        // Builds the nodes over infos, which ends up in leaf order
+        void BuildNodes(std::vector<PrimitiveInfo>& infos) {
+            if (infos.empty()) {
+                return;
+            }
+
+            // A binary tree over n leaves has less than 2n nodes
+            mNodes.reserve(2 * infos.size());
+            BuildRecursive(infos, 0, infos.size(), 0);
+        }
+
+        // Appends the subtree over infos[start, end[ in depth first order and returns the index of its root
+        uint32_t BuildRecursive(std::vector<PrimitiveInfo>& infos, size_t start, size_t end, int depth) {
+            mMaxDepth = std::max(mMaxDepth, depth);
+
+            uint32_t nodeIndex = static_cast<uint32_t>(mNodes.size());
+            mNodes.push_back(FlatBvhNode());
+
+            Aabb bounds;
+            for (size_t i = start; i < end; i++) {
+                bounds.Grow(infos[i].box);
+            }
+
+            size_t count = end - start;
+            size_t mid = start;
+            int axis = 0;
+
+            if (count > maxLeafSize && depth >= maxSahDepth) {
+                mid = start + count / 2;
+            }
+            else if (count > 1) {
+                double splitCost = infinity;
+                auto middle = SahPartition(infos.begin() + start, infos.begin() + end, [](const PrimitiveInfo& info) { return info.box; }, &splitCost, &axis);
+                mid = static_cast<size_t>(middle - infos.begin());
+
+                // Intersecting a primitive and visiting a node are given the same cost
+                double leafCost = count * bounds.SurfaceArea();
+                double nodeCost = bounds.SurfaceArea() + splitCost;
+
+                if (mid == start || mid == end) {
+                    // Centroids can't be separated, only split when the leaf would be too large
+                    mid = count > maxLeafSize ? start + count / 2 : start;
+                    axis = 0;
+                }
+                else if (count <= maxLeafSize && leafCost <= nodeCost) {
+                    mid = start;
+                }
+            }
+
+            FlatBvhNode& node = mNodes[nodeIndex];
+            for (int a = 0; a < 3; a++) {
+                node.boundsMin[a] = bounds.min()[a];
+                node.boundsMax[a] = bounds.max()[a];
+            }
+
+            if (mid == start) {
+                node.offset = static_cast<uint32_t>(start);
+                node.primitiveCount = static_cast<uint16_t>(count);
+                node.axis = 0;
+                return nodeIndex;
+            }
+
+            BuildRecursive(infos, start, mid, depth + 1);
+            uint32_t secondChild = BuildRecursive(infos, mid, end, depth + 1);
+
+            // mNodes may have been reallocated by the recursion
+            mNodes[nodeIndex].primitiveCount = 0;
+            mNodes[nodeIndex].axis = static_cast<uint8_t>(axis);
+            mNodes[nodeIndex].offset = secondChild;
+
+            return nodeIndex;
+        }
+};
+
+using FlatBvh = FlatBvhT<HittableLeaves>;
+
+template <typename LeafStorage>
+void PrintFlatBvhReport(std::ostream& out, const FlatBvhT<LeafStorage>& bvh) {
+    out << "Flat BVH: " << bvh.PrimitiveCount() << " primitives, " << bvh.NodeCount() << " nodes, depth " << bvh.MaxDepth()
+        << ", " << bvh.MemoryFootprint() / 1024.0 << " KiB | build " << bvh.BuildMilliseconds() << " ms\n";
+
+    BvhTraversalCounters counters = BvhTraversalRegistry::Instance().Total();
+    if (counters.rays > 0) {
+        out << "  " << counters.rays << " rays, " << double(counters.nodesVisited) / counters.rays << " nodes visited and "
+            << double(counters.primitivesTested) / counters.rays << " primitives tested per ray\n";
+    }
+}
+
+#endif //FLAT_BVH_H
@@ -0,0 +1,69 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <algorithm>
+#include <vector>
+
+#include "Vec3.h"
+
+// Accumulated (not yet averaged) color of every pixel, stored top row first like the output file
+class Framebuffer {
+    public:
+        Framebuffer(int width, int height) : mWidth(width), mHeight(height), mPixels(width * height, Vec3(0, 0, 0)), mSampleCounts(width * height, 0) {}
+
+        int Width() const { return mWidth; }
+        int Height() const { return mHeight; }
+
+        Vec3& At(int x, int y) { return mPixels[y * mWidth + x]; }
+        const Vec3& At(int x, int y) const { return mPixels[y * mWidth + x]; }
+
+        // Samples accumulated in a pixel, they differ between pixels with adaptive sampling
+        int SampleCount(int x, int y) const { return mSampleCounts[y * mWidth + x]; }
+        void SetSampleCount(int x, int y, int count) { mSampleCounts[y * mWidth + x] = count; }
+
+        void ResetSampleCounts(int count) { std::fill(mSampleCounts.begin(), mSampleCounts.end(), count); }
+
+        void Clear() {
+            std::fill(mPixels.begin(), mPixels.end(), Vec3(0, 0, 0));
+            ResetSampleCounts(0);
+        }
+
+        // Raw storage, width * height entries top row first, for checkpoints
+        Vec3* Pixels() { return mPixels.data(); }
+        const Vec3* Pixels() const { return mPixels.data(); }
+        int* SampleCounts() { return mSampleCounts.data(); }
+        const int* SampleCounts() const { return mSampleCounts.data(); }
+
+    private:
+        int mWidth;
+        int mHeight;
+        std::vector<Vec3> mPixels;
+        std::vector<int> mSampleCounts;
+};
+
+// First hit features of every pixel for the denoiser, averaged over a few samples and stored top row first
+// Albedo of the material hit (the sky color on a miss), shading normal and distance along the ray (both 0 on a miss)
+class AovBuffers {
+    public:
+        AovBuffers(int width, int height) : mWidth(width), mHeight(height), mAlbedo(width * height, Vec3(0, 0, 0)),
+            mNormal(width * height, Vec3(0, 0, 0)), mDepth(width * height, 0.0f) {}
+
+        int Width() const { return mWidth; }
+        int Height() const { return mHeight; }
+
+        Vec3& Albedo(int x, int y) { return mAlbedo[y * mWidth + x]; }
+        const Vec3& Albedo(int x, int y) const { return mAlbedo[y * mWidth + x]; }
+        Vec3& Normal(int x, int y) { return mNormal[y * mWidth + x]; }
+        const Vec3& Normal(int x, int y) const { return mNormal[y * mWidth + x]; }
+        float& Depth(int x, int y) { return mDepth[y * mWidth + x]; }
+        float Depth(int x, int y) const { return mDepth[y * mWidth + x]; }
+
+    private:
+        int mWidth;
+        int mHeight;
+        std::vector<Vec3> mAlbedo;
+        std::vector<Vec3> mNormal;
+        std::vector<float> mDepth;
+};
+
+#endif //FRAMEBUFFER_H
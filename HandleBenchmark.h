@@ -0,0 +1,114 @@
+#ifndef HANDLE_BENCHMARK_H
+#define HANDLE_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "Utility.h"
+#include "HittableList.h"
+#include "Sphere.h"
+
+struct HandleBenchmarkResult {
+    int threadCount = 0;
+    uint64_t rays = 0;
+    // Successful object hits, each one used to copy the material shared_ptr twice (Sphere::Hit and rec = tempRec)
+    uint64_t hits = 0;
+    double rawSeconds = 0.0;
+    double sharedSeconds = 0.0;
+};
+
+// Traces the same rays through every object of world (as HittableList::Hit does) with raw material pointers, then again
+// copying a shared_ptr per material the way HitRecord used to, to measure what the reference counts cost
+HandleBenchmarkResult RunHandleBenchmark(const HittableList& world, const Vec3& origin, int rayCount, int threadCount) {
+    HandleBenchmarkResult result;
+    result.threadCount = std::max(1, threadCount);
+
+    // One reference count per material like make_shared gave, shared by all the threads
+    std::vector<shared_ptr<const Material>> handles;
+    for (const auto& object : world.objects) {
+        const Sphere* sphere = dynamic_cast<const Sphere*>(object.get());
+        const Material* mat = sphere ? sphere->mMatPtr : nullptr;
+        handles.push_back(shared_ptr<const Material>(mat, [](const Material*) {}));
+    }
+
+    SeedRandom(0, 0);
+    std::vector<Ray> rays;
+    rays.reserve(rayCount);
+    for (int i = 0; i < rayCount; i++) {
+        Vec3 target(RandomDouble(-11.0, 11.0), RandomDouble(0.0, 1.0), RandomDouble(-11.0, 11.0));
+        rays.push_back(Ray(origin, target - origin));
+    }
+
+    auto run = [&](bool copyHandles, uint64_t& hits) {
+        std::vector<uint64_t> threadHits(result.threadCount, 0);
+        auto worker = [&](int thread) {
+            uint64_t count = 0;
+            for (size_t r = thread; r < rays.size(); r += result.threadCount) {
+                HitRecord tempRec;
+                shared_ptr<const Material> recHandle;
+                shared_ptr<const Material> tempHandle;
+                double closestSoFar = infinity;
+
+                for (size_t i = 0; i < world.objects.size(); i++) {
+                    if (world.objects[i]->Hit(rays[r], 0.001, closestSoFar, tempRec)) {
+                        closestSoFar = tempRec.t;
+                        count++;
+                        if (copyHandles) {
+                            tempHandle = handles[i];
+                            recHandle = tempHandle;
+                        }
+                    }
+                }
+            }
+            threadHits[thread] = count;
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 1; t < result.threadCount; t++) {
+            workers.emplace_back(worker, t);
+        }
+        worker(0);
+        for (std::thread& t : workers) {
+            t.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        hits = 0;
+        for (uint64_t h : threadHits) {
+            hits += h;
+        }
+        return seconds;
+    };
+
+    // Best of a few alternated runs, so neither side pays for warming the caches
+    uint64_t sharedHits = 0;
+    result.rawSeconds = infinity;
+    result.sharedSeconds = infinity;
+    for (int repeat = 0; repeat < 3; repeat++) {
+        result.rawSeconds = std::min(result.rawSeconds, run(false, result.hits));
+        result.sharedSeconds = std::min(result.sharedSeconds, run(true, sharedHits));
+    }
+    result.rays = rays.size();
+
+    return result;
+}
+
+void PrintHandleBenchmark(std::ostream& out, const HandleBenchmarkResult& result) {
+    if (result.rays == 0) {
+        return;
+    }
+
+    // A copy increments the new count and decrements the one it overwrites
+    uint64_t atomicOps = 4 * result.hits;
+    out << "Material handles (" << result.threadCount << " threads, " << result.rays << " rays): "
+        << double(result.hits) / result.rays << " hits per ray, shared_ptr " << double(atomicOps) / result.rays << " atomic ops per ray, raw pointer 0\n"
+        << "  shared_ptr " << result.rays / result.sharedSeconds / 1e6 << " Mrays/s, raw pointer " << result.rays / result.rawSeconds / 1e6
+        << " Mrays/s (x" << result.sharedSeconds / result.rawSeconds << ")\n";
+}
+
+#endif //HANDLE_BENCHMARK_H
@@ -2,27 +2,42 @@
 #define HITTABLE_H
 
 #include "Ray.h"
+#include "Aabb.h"
+#include "RayPacket.h"
 
 class Material;
 
-struct HitRecord {
-    Vec3 p;
-    Vec3 normal;
-    double t;
+template <typename T>
+struct HitRecordT {
+    Vec3T<T> p;
+    Vec3T<T> normal;
+    T t;
     // Normal direction
     bool frontFace;
-    // materialPtr will point to the material pointer of the sphere when it will be set up in main()
-    shared_ptr<Material> materialPtr;
+    // Material of the object that was hit, owned by the scene: a plain pointer so hits never touch a reference count
+    const Material* materialPtr;
 
-    inline void SetFaceNormal(const Ray& r, const Vec3& outwardNormal) {
+    inline void SetFaceNormal(const RayT<T>& r, const Vec3T<T>& outwardNormal) {
         frontFace = dot(r.direction(), outwardNormal) < 0;
         normal = frontFace ? outwardNormal :-outwardNormal;
     }
 };
 
+typedef HitRecordT<Real> HitRecord;
+
 class Hittable {
     public:
-        virtual bool Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) const = 0;
+        virtual bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const = 0;
+        // Returns false when the object can't be bounded
+        virtual bool BoundingBox(Aabb& outputBox) const = 0;
+
+        // Traces every ray of the packet, hits[i] tells whether recs[i] was filled
+        // Structures that can share work between coherent rays override this
+        virtual void HitPacket(const RayPacket& packet, Real tMin, Real tMax, HitRecord* recs, bool* hits) const {
+            for (int i = 0; i < packet.count; i++) {
+                hits[i] = Hit(packet.rays[i], tMin, tMax, recs[i]);
+            }
+        }
 };
 
 #endif
\ No newline at end of file
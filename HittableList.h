@@ -2,6 +2,7 @@
 #define HITTABLE_LIST_H
 
 #include "Hittable.h"
+#include "Profiler.h"
 
 #include <memory>
 #include <vector>
@@ -17,13 +18,16 @@ class HittableList : public Hittable {
         void Clear() { objects.clear(); }
         void Add(shared_ptr<Hittable> object) { objects.push_back(object); }
 
-        bool Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) const override;
+        bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const override;
+        bool BoundingBox(Aabb& outputBox) const override;
 
     public:  
         std::vector<shared_ptr<Hittable>> objects;
 };
 
-bool HittableList::Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) const {
+bool HittableList::Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const {
+    PROFILE_COUNT(listCalls);
+
     HitRecord tempRec;
     bool hitAnything = false;
     double closestSoFar = tMax;
@@ -36,7 +40,28 @@ bool HittableList::Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) c
         }
     }
 
+    if (hitAnything) {
+        PROFILE_COUNT(listHits);
+    }
     return hitAnything;
 }
 
+bool HittableList::BoundingBox(Aabb& outputBox) const {
+    if (objects.empty()) {
+        return false;
+    }
+
+    Aabb tempBox;
+    outputBox = Aabb();
+
+    for (const auto& object : objects) {
+        if (!object->BoundingBox(tempBox)) {
+            return false;
+        }
+        outputBox.Grow(tempBox);
+    }
+
+    return true;
+}
+
 #endif //HITTABLE_LIST_H
\ No newline at end of file
@@ -0,0 +1,126 @@
+#ifndef IMAGE_DIFF_H
+#define IMAGE_DIFF_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Framebuffer.h"
+
+// Linear RGB image read back from a PFM, rows top to bottom
+struct FloatImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> rgb;
+};
+
+// Reads the PFM files written by PfmWriter (and other color PFMs), false when the file can't be read
+bool ReadPfm(const std::string& path, FloatImage& image) {
+    std::ifstream file(path, std::ios::binary);
+    std::string magic;
+    double scale = 0.0;
+    if (!(file >> magic >> image.width >> image.height >> scale) || magic != "PF" || image.width <= 0 || image.height <= 0) {
+        std::cerr << "Can't read " << path << " as a color PFM.\n";
+        return false;
+    }
+    // One whitespace character ends the header
+    file.get();
+
+    size_t rowFloats = 3 * static_cast<size_t>(image.width);
+    image.rgb.resize(rowFloats * image.height);
+    for (int y = image.height - 1; y >= 0; y--) {
+        file.read(reinterpret_cast<char*>(&image.rgb[rowFloats * y]), rowFloats * sizeof(float));
+    }
+    if (!file) {
+        std::cerr << path << " is truncated.\n";
+        return false;
+    }
+
+    uint16_t probe = 1;
+    bool littleEndian = *reinterpret_cast<unsigned char*>(&probe) == 1;
+    if ((scale < 0.0) != littleEndian) {
+        for (float& value : image.rgb) {
+            unsigned char* bytes = reinterpret_cast<unsigned char*>(&value);
+            std::swap(bytes[0], bytes[3]);
+            std::swap(bytes[1], bytes[2]);
+        }
+    }
+
+    return true;
+}
+
+// Averages of a framebuffer, as ReadPfm() would read them back from a PFM of it
+FloatImage ToFloatImage(const Framebuffer& framebuffer) {
+    FloatImage image;
+    image.width = framebuffer.Width();
+    image.height = framebuffer.Height();
+    image.rgb.reserve(3 * static_cast<size_t>(image.width) * image.height);
+    for (int y = 0; y < image.height; y++) {
+        for (int x = 0; x < image.width; x++) {
+            double scale = 1.0 / std::max(1, framebuffer.SampleCount(x, y));
+            const Vec3& sum = framebuffer.At(x, y);
+            for (int c = 0; c < 3; c++) {
+                image.rgb.push_back(static_cast<float>(sum[c] * scale));
+            }
+        }
+    }
+    return image;
+}
+
+// Differences between two renders of the same frame, computed on the linear values clamped to [0, 1] as displayed
+struct ImageDifference {
+    bool valid = false;
+    double rmse = 0.0;
+    double meanAbsolute = 0.0;
+    double maxAbsolute = 0.0;
+    // Infinite for identical images
+    double psnr = 0.0;
+    // Pixels with a channel off by more than 1/255, visible once quantized
+    double visiblePixelsPercent = 0.0;
+};
+
+ImageDifference CompareImages(const FloatImage& a, const FloatImage& b) {
+    ImageDifference diff;
+    if (a.width != b.width || a.height != b.height || a.rgb.empty()) {
+        return diff;
+    }
+
+    double squares = 0.0;
+    double absolutes = 0.0;
+    size_t visible = 0;
+    for (size_t i = 0; i < a.rgb.size(); i += 3) {
+        bool pixelVisible = false;
+        for (size_t c = i; c < i + 3; c++) {
+            double d = std::fabs(std::min(std::max(double(a.rgb[c]), 0.0), 1.0) - std::min(std::max(double(b.rgb[c]), 0.0), 1.0));
+            squares += d * d;
+            absolutes += d;
+            diff.maxAbsolute = std::max(diff.maxAbsolute, d);
+            pixelVisible = pixelVisible || d > 1.0 / 255.0;
+        }
+        visible += pixelVisible ? 1 : 0;
+    }
+
+    double mse = squares / a.rgb.size();
+    diff.valid = true;
+    diff.rmse = std::sqrt(mse);
+    diff.meanAbsolute = absolutes / a.rgb.size();
+    diff.psnr = mse > 0.0 ? 10.0 * std::log10(1.0 / mse) : INFINITY;
+    diff.visiblePixelsPercent = 100.0 * visible / (a.rgb.size() / 3);
+    return diff;
+}
+
+void PrintImageDifference(std::ostream& out, const ImageDifference& diff) {
+    if (!diff.valid) {
+        out << "Images can't be compared (missing or of different sizes)\n";
+        return;
+    }
+    out << "RMSE " << diff.rmse << " | mean " << diff.meanAbsolute << " | max " << diff.maxAbsolute << " | PSNR " << diff.psnr
+        << " dB | " << diff.visiblePixelsPercent << "% of the pixels visibly different\n";
+}
+
+#endif //IMAGE_DIFF_H
@@ -0,0 +1,411 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Utility.h"
+#include "Framebuffer.h"
+#include "Color.h"
+
+enum class ImageFormat {
+    // Binary 8 bit sRGB-ish (gamma 2) PPM
+    Ppm,
+    // ASCII P3 PPM, the historical output of WriteColor()
+    PpmText,
+    // Linear 32 bit float RGB, for HDR compositing
+    Pfm,
+    // 8 bit RGB PNG
+    Png
+};
+
+// Picks the format from the file extension, binary PPM when it isn't known
+ImageFormat ImageFormatFromPath(const std::string& path) {
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    if (extension == "pfm") return ImageFormat::Pfm;
+    if (extension == "png") return ImageFormat::Png;
+    return ImageFormat::Ppm;
+}
+
+// Same mapping as WriteColor(): average, gamma 2, [0, 255]
+inline void PixelToBytes(const Vec3& sum, int samples, unsigned char* out) {
+    double scale = samples > 0 ? 1.0 / samples : 0.0;
+    for (int c = 0; c < 3; c++) {
+        out[c] = static_cast<unsigned char>(255.999 * Clamp(sqrt(scale * sum[c]), 0.0, 0.999));
+    }
+}
+
+// Writes a framebuffer to a stream, all at once or a band of rows at a time while the render goes on
+// Rows are given top to bottom and each row once: Begin(), WriteRows() as many times as needed, End()
+class ImageWriter {
+    protected:
+        std::ostream* mOut = nullptr;
+        int mWidth = 0;
+        int mHeight = 0;
+
+    public:
+        virtual ~ImageWriter() {}
+
+        static std::unique_ptr<ImageWriter> Create(ImageFormat format);
+
+        virtual void Begin(std::ostream& out, int width, int height) {
+            mOut = &out;
+            mWidth = width;
+            mHeight = height;
+        }
+        // Rows [y0, y1[ of the framebuffer
+        virtual void WriteRows(const Framebuffer& framebuffer, int y0, int y1) = 0;
+        virtual void End() { mOut->flush(); }
+
+    protected:
+        // 8 bit rows [y0, y1[, each prefixed with prefix (the PNG filter byte) when prefix >= 0
+        void RowBytes(const Framebuffer& framebuffer, int y0, int y1, int prefix, std::vector<unsigned char>& bytes) const {
+            size_t rowSize = 3 * mWidth + (prefix >= 0 ? 1 : 0);
+            bytes.resize(rowSize * (y1 - y0));
+
+            unsigned char* p = bytes.data();
+            for (int y = y0; y < y1; y++) {
+                if (prefix >= 0) {
+                    *p++ = static_cast<unsigned char>(prefix);
+                }
+                for (int x = 0; x < mWidth; x++, p += 3) {
+                    PixelToBytes(framebuffer.At(x, y), framebuffer.SampleCount(x, y), p);
+                }
+            }
+        }
+};
+
+class PpmTextWriter : public ImageWriter {
+    public:
+        virtual void Begin(std::ostream& out, int width, int height) override {
+            ImageWriter::Begin(out, width, height);
+            out << "P3\n" << width << " " << height << "\n255\n";
+        }
+
+        virtual void WriteRows(const Framebuffer& framebuffer, int y0, int y1) override {
+            for (int y = y0; y < y1; ++y) {
+                for (int x = 0; x < mWidth; ++x) {
+                    WriteColor(*mOut, framebuffer.At(x, y), framebuffer.SampleCount(x, y));
+                }
+            }
+        }
+};
+
+class PpmWriter : public ImageWriter {
+    private:
+        std::vector<unsigned char> mBytes;
+
+    public:
+        virtual void Begin(std::ostream& out, int width, int height) override {
+            ImageWriter::Begin(out, width, height);
+            out << "P6\n" << width << " " << height << "\n255\n";
+        }
+
+        virtual void WriteRows(const Framebuffer& framebuffer, int y0, int y1) override {
+            RowBytes(framebuffer, y0, y1, -1, mBytes);
+            mOut->write(reinterpret_cast<const char*>(mBytes.data()), mBytes.size());
+        }
+};
+
+// PFM stores the bottom row first, so bands are written backwards from the end of the file
+// Streaming needs a seekable stream (a file), a single WriteRows() over the whole image writes straight through
+class PfmWriter : public ImageWriter {
+    private:
+        std::streampos mDataStart;
+        std::vector<float> mFloats;
+
+    public:
+        virtual void Begin(std::ostream& out, int width, int height) override {
+            ImageWriter::Begin(out, width, height);
+
+            // The sign of the scale gives the byte order of the floats
+            uint16_t probe = 1;
+            bool littleEndian = *reinterpret_cast<unsigned char*>(&probe) == 1;
+            out << "PF\n" << width << " " << height << "\n" << (littleEndian ? "-1.0" : "1.0") << "\n";
+            mDataStart = out.tellp();
+        }
+
+        virtual void WriteRows(const Framebuffer& framebuffer, int y0, int y1) override {
+            mFloats.resize(3 * static_cast<size_t>(mWidth) * (y1 - y0));
+
+            float* p = mFloats.data();
+            for (int y = y1 - 1; y >= y0; y--) {
+                for (int x = 0; x < mWidth; x++) {
+                    int samples = framebuffer.SampleCount(x, y);
+                    float scale = samples > 0 ? 1.0f / samples : 0.0f;
+                    const Vec3& sum = framebuffer.At(x, y);
+                    *p++ = sum.x() * scale;
+                    *p++ = sum.y() * scale;
+                    *p++ = sum.z() * scale;
+                }
+            }
+
+            std::streamoff rowSize = 3 * sizeof(float) * static_cast<std::streamoff>(mWidth);
+            std::streampos position = mDataStart + (mHeight - y1) * rowSize;
+            if (mOut->tellp() != position) {
+                mOut->seekp(position);
+            }
+            mOut->write(reinterpret_cast<const char*>(mFloats.data()), mFloats.size() * sizeof(float));
+        }
+};
+
+// PNG without compression: the zlib stream is made of stored deflate blocks, which keeps the writer free of
+// dependencies and as fast as a plain copy. Every band becomes one IDAT chunk, so the file can be streamed
+class PngWriter : public ImageWriter {
+    private:
+        std::vector<unsigned char> mRows;
+        std::vector<unsigned char> mChunk;
+        uint32_t mAdlerA = 1;
+        uint32_t mAdlerB = 0;
+        int mRowsWritten = 0;
+
+    public:
+        virtual void Begin(std::ostream& out, int width, int height) override {
+            ImageWriter::Begin(out, width, height);
+            mAdlerA = 1;
+            mAdlerB = 0;
+            mRowsWritten = 0;
+
+            static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+            out.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+            // Width, height, 8 bits, RGB, deflate, adaptive filtering, no interlace
+            std::vector<unsigned char> header;
+            PutBigEndian(header, width);
+            PutBigEndian(header, height);
+            header.insert(header.end(), { 8, 2, 0, 0, 0 });
+            WriteChunk("IHDR", header);
+        }
+
+        virtual void WriteRows(const Framebuffer& framebuffer, int y0, int y1) override {
+            // Filter type 0 (none) in front of every row
+            RowBytes(framebuffer, y0, y1, 0, mRows);
+            UpdateAdler(mRows);
+
+            mChunk.clear();
+            if (mRowsWritten == 0) {
+                // zlib header: deflate, 32K window, no dictionary, fastest
+                mChunk.push_back(0x78);
+                mChunk.push_back(0x01);
+            }
+            mRowsWritten += y1 - y0;
+            bool last = mRowsWritten == mHeight;
+
+            // Stored blocks hold at most 65535 bytes
+            for (size_t offset = 0; offset < mRows.size(); offset += 65535) {
+                size_t length = std::min<size_t>(65535, mRows.size() - offset);
+                bool finalBlock = last && offset + length == mRows.size();
+                mChunk.push_back(finalBlock ? 1 : 0);
+                mChunk.push_back(length & 0xff);
+                mChunk.push_back((length >> 8) & 0xff);
+                mChunk.push_back(~length & 0xff);
+                mChunk.push_back((~length >> 8) & 0xff);
+                mChunk.insert(mChunk.end(), mRows.begin() + offset, mRows.begin() + offset + length);
+            }
+
+            if (last) {
+                PutBigEndian(mChunk, (mAdlerB << 16) | mAdlerA);
+            }
+            WriteChunk("IDAT", mChunk);
+        }
+
+        virtual void End() override {
+            WriteChunk("IEND", std::vector<unsigned char>());
+            ImageWriter::End();
+        }
+
+    private:
+        static void PutBigEndian(std::vector<unsigned char>& bytes, uint32_t value) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                bytes.push_back((value >> shift) & 0xff);
+            }
+        }
+
+        static uint32_t Crc32(uint32_t crc, const unsigned char* data, size_t size) {
+            static const std::vector<uint32_t> table = [] {
+                std::vector<uint32_t> t(256);
+                for (uint32_t n = 0; n < 256; n++) {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; k++) {
+                        c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                    }
+                    t[n] = c;
+                }
+                return t;
+            }();
+
+            crc = ~crc;
+            for (size_t i = 0; i < size; i++) {
+                crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        void UpdateAdler(const std::vector<unsigned char>& bytes) {
+            // 5552 bytes is the most that can be summed before the 32 bit sums may overflow
+            for (size_t i = 0; i < bytes.size(); ) {
+                size_t end = std::min(bytes.size(), i + 5552);
+                for (; i < end; i++) {
+                    mAdlerA += bytes[i];
+                    mAdlerB += mAdlerA;
+                }
+                mAdlerA %= 65521;
+                mAdlerB %= 65521;
+            }
+        }
+
+        void WriteChunk(const char* type, const std::vector<unsigned char>& data) {
+            std::vector<unsigned char> header;
+            PutBigEndian(header, static_cast<uint32_t>(data.size()));
+            header.insert(header.end(), type, type + 4);
+
+            uint32_t crc = Crc32(0, header.data() + 4, 4);
+            crc = Crc32(crc, data.data(), data.size());
+            std::vector<unsigned char> footer;
+            PutBigEndian(footer, crc);
+
+            mOut->write(reinterpret_cast<const char*>(header.data()), header.size());
+            mOut->write(reinterpret_cast<const char*>(data.data()), data.size());
+            mOut->write(reinterpret_cast<const char*>(footer.data()), footer.size());
+        }
+};
+
+std::unique_ptr<ImageWriter> ImageWriter::Create(ImageFormat format) {
+    switch (format) {
+        case ImageFormat::PpmText: return std::unique_ptr<ImageWriter>(new PpmTextWriter());
+        case ImageFormat::Pfm: return std::unique_ptr<ImageWriter>(new PfmWriter());
+        case ImageFormat::Png: return std::unique_ptr<ImageWriter>(new PngWriter());
+        default: return std::unique_ptr<ImageWriter>(new PpmWriter());
+    }
+}
+
+// An image file written band by band, typically from TileRenderer::OnRowsCompleted()
+class ImageFile {
+    private:
+        std::ofstream mFile;
+        std::unique_ptr<ImageWriter> mWriter;
+
+    public:
+        ImageFile(const std::string& path, ImageFormat format, int width, int height)
+            : mFile(path, std::ios::binary), mWriter(ImageWriter::Create(format)) {
+            if (!mFile) {
+                std::cerr << "Can't open " << path << " for writing.\n";
+                return;
+            }
+            mWriter->Begin(mFile, width, height);
+        }
+        ImageFile(const std::string& path, int width, int height) : ImageFile(path, ImageFormatFromPath(path), width, height) {}
+
+        bool IsOpen() const { return mFile.is_open(); }
+
+        void WriteRows(const Framebuffer& framebuffer, int y0, int y1) {
+            if (mFile) {
+                mWriter->WriteRows(framebuffer, y0, y1);
+            }
+        }
+
+        bool Close() {
+            if (!mFile) {
+                return false;
+            }
+            mWriter->End();
+            mFile.close();
+            return !mFile.fail();
+        }
+};
+
+// Writes the whole framebuffer in one go, the format follows the extension unless given
+bool WriteImage(const std::string& path, const Framebuffer& framebuffer, ImageFormat format) {
+    ImageFile file(path, format, framebuffer.Width(), framebuffer.Height());
+    file.WriteRows(framebuffer, 0, framebuffer.Height());
+    return file.Close();
+}
+
+bool WriteImage(const std::string& path, const Framebuffer& framebuffer) {
+    return WriteImage(path, framebuffer, ImageFormatFromPath(path));
+}
+
+// Writes <prefix>-albedo, <prefix>-normal and <prefix>-depth with the given extension, normals mapped from [-1, 1] to
+// [0, 1] and depths divided by the farthest hit, so they can be looked at in any format
+bool WriteAovImages(const std::string& prefix, const std::string& extension, const AovBuffers& aovs) {
+    int width = aovs.Width();
+    int height = aovs.Height();
+    float farthest = 0.0f;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            farthest = std::max(farthest, aovs.Depth(x, y));
+        }
+    }
+
+    Framebuffer albedo(width, height);
+    Framebuffer normal(width, height);
+    Framebuffer depth(width, height);
+    for (Framebuffer* image : { &albedo, &normal, &depth }) {
+        image->ResetSampleCounts(1);
+    }
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            albedo.At(x, y) = aovs.Albedo(x, y);
+            normal.At(x, y) = Real(0.5) * aovs.Normal(x, y) + Vec3(0.5, 0.5, 0.5);
+            Real d = farthest > 0.0f ? aovs.Depth(x, y) / farthest : 0.0f;
+            depth.At(x, y) = Vec3(d, d, d);
+        }
+    }
+
+    bool written = WriteImage(prefix + "-albedo" + extension, albedo);
+    written = WriteImage(prefix + "-normal" + extension, normal) && written;
+    return WriteImage(prefix + "-depth" + extension, depth) && written;
+}
+
+// Time to write 4K and 8K frames in every format, in one go and streamed by bands of bandHeight rows
+void RunImageWriteBenchmark(std::ostream& out, int bandHeight = 16) {
+    struct Size { const char* name; int width; int height; };
+    struct Format { const char* name; ImageFormat format; const char* path; };
+    const Size sizes[] = { { "4K", 3840, 2160 }, { "8K", 7680, 4320 } };
+    const Format formats[] = {
+        { "P3 text", ImageFormat::PpmText, "image_benchmark.ppm" },
+        { "P6", ImageFormat::Ppm, "image_benchmark.ppm" },
+        { "PFM", ImageFormat::Pfm, "image_benchmark.pfm" },
+        { "PNG", ImageFormat::Png, "image_benchmark.png" }
+    };
+
+    for (const Size& size : sizes) {
+        Framebuffer framebuffer(size.width, size.height);
+        framebuffer.ResetSampleCounts(4);
+        for (int y = 0; y < size.height; y++) {
+            for (int x = 0; x < size.width; x++) {
+                framebuffer.At(x, y) = Vec3(4.0f * x / size.width, 4.0f * y / size.height, 2.0f);
+            }
+        }
+
+        out << "Image write " << size.name << " (" << size.width << "x" << size.height << "):\n";
+        for (const Format& format : formats) {
+            for (int streamed = 0; streamed < 2; streamed++) {
+                auto start = std::chrono::steady_clock::now();
+                ImageFile file(format.path, format.format, size.width, size.height);
+                int band = streamed ? bandHeight : size.height;
+                for (int y = 0; y < size.height; y += band) {
+                    file.WriteRows(framebuffer, y, std::min(y + band, size.height));
+                }
+                file.Close();
+                double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                std::ifstream written(format.path, std::ios::binary | std::ios::ate);
+                double megabytes = written.tellg() / (1024.0 * 1024.0);
+                written.close();
+                std::remove(format.path);
+
+                out << "  " << format.name << (streamed ? " streamed" : " bulk") << ": " << milliseconds << " ms, " << megabytes << " MiB\n";
+            }
+        }
+    }
+}
+
+#endif //IMAGE_WRITER_H
@@ -0,0 +1,297 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Aabb.h"
+#include "FlatBvh.h"
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Utility.h"
+
+// Rotation, scale and translation as a 3x4 matrix: p' = m[.][0..2] * p + m[.][3]
+class AffineTransform {
+    public:
+        Real m[3][4];
+
+    public:
+        AffineTransform() {
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    m[r][c] = r == c ? 1 : 0;
+                }
+            }
+        }
+
+        static AffineTransform Translate(const Vec3& offset) {
+            AffineTransform t;
+            for (int r = 0; r < 3; r++) {
+                t.m[r][3] = offset[r];
+            }
+            return t;
+        }
+
+        static AffineTransform Scale(const Vec3& factors) {
+            AffineTransform t;
+            for (int r = 0; r < 3; r++) {
+                t.m[r][r] = factors[r];
+            }
+            return t;
+        }
+
+        static AffineTransform Scale(Real factor) { return Scale(Vec3(factor, factor, factor)); }
+
+        // Rodrigues' rotation about a unit axis, counterclockwise looking down the axis
+        static AffineTransform Rotate(const Vec3& axis, double degrees) {
+            Vec3 a = unitVector(axis);
+            Real c = static_cast<Real>(std::cos(DegreesToRadians(degrees)));
+            Real s = static_cast<Real>(std::sin(DegreesToRadians(degrees)));
+            Real k = 1 - c;
+            AffineTransform t;
+            t.m[0][0] = c + a.x() * a.x() * k;         t.m[0][1] = a.x() * a.y() * k - a.z() * s; t.m[0][2] = a.x() * a.z() * k + a.y() * s;
+            t.m[1][0] = a.y() * a.x() * k + a.z() * s; t.m[1][1] = c + a.y() * a.y() * k;         t.m[1][2] = a.y() * a.z() * k - a.x() * s;
+            t.m[2][0] = a.z() * a.x() * k - a.y() * s; t.m[2][1] = a.z() * a.y() * k + a.x() * s; t.m[2][2] = c + a.z() * a.z() * k;
+            return t;
+        }
+
+        // this applied after b
+        AffineTransform operator*(const AffineTransform& b) const {
+            AffineTransform t;
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    t.m[r][c] = m[r][0] * b.m[0][c] + m[r][1] * b.m[1][c] + m[r][2] * b.m[2][c] + (c == 3 ? m[r][3] : 0);
+                }
+            }
+            return t;
+        }
+
+        // Through the adjugate of the linear part, the transform must not be singular
+        AffineTransform Inverse() const {
+            AffineTransform t;
+            t.m[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+            t.m[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+            t.m[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+            t.m[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+            t.m[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+            t.m[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+            t.m[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+            t.m[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+            t.m[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+            Real inverseDeterminant = 1 / (m[0][0] * t.m[0][0] + m[0][1] * t.m[1][0] + m[0][2] * t.m[2][0]);
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    t.m[r][c] *= inverseDeterminant;
+                }
+            }
+            for (int r = 0; r < 3; r++) {
+                t.m[r][3] = -(t.m[r][0] * m[0][3] + t.m[r][1] * m[1][3] + t.m[r][2] * m[2][3]);
+            }
+            return t;
+        }
+
+        Vec3 Vector(const Vec3& v) const {
+            return Vec3(m[0][0] * v.x() + m[0][1] * v.y() + m[0][2] * v.z(),
+                        m[1][0] * v.x() + m[1][1] * v.y() + m[1][2] * v.z(),
+                        m[2][0] * v.x() + m[2][1] * v.y() + m[2][2] * v.z());
+        }
+
+        Vec3 Point(const Vec3& p) const { return Vector(p) + Vec3(m[0][3], m[1][3], m[2][3]); }
+
+        // Box around the 8 transformed corners of box
+        Aabb Box(const Aabb& box) const {
+            Aabb result;
+            for (int corner = 0; corner < 8; corner++) {
+                Vec3 p((corner & 1) ? box.max().x() : box.min().x(), (corner & 2) ? box.max().y() : box.min().y(),
+                       (corner & 4) ? box.max().z() : box.min().z());
+                result.Grow(Point(p));
+            }
+            return result;
+        }
+
+        // Rows one after the other, the compact form instances are stored in
+        void Store(float out[12]) const {
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    out[r * 4 + c] = static_cast<float>(m[r][c]);
+                }
+            }
+        }
+
+        static AffineTransform Load(const float in[12]) {
+            AffineTransform t;
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 4; c++) {
+                    t.m[r][c] = in[r * 4 + c];
+                }
+            }
+            return t;
+        }
+};
+
+// Hit of prototype seen through worldToObject (stored rows): the ray is taken into the prototype's space, the hit is
+// brought back. The direction isn't renormalized, so t is the same in both spaces and tMin/tMax need no change
+// material replaces the prototype's own when not null
+inline bool HitInstance(const Hittable& prototype, const float* worldToObject, const Material* material, const Ray& r, Real tMin, Real tMax, HitRecord& rec) {
+    const float* w = worldToObject;
+    const Vec3 o = r.origin();
+    const Vec3 d = r.direction();
+    Ray local(Vec3(w[0] * o.x() + w[1] * o.y() + w[2] * o.z() + w[3],
+                   w[4] * o.x() + w[5] * o.y() + w[6] * o.z() + w[7],
+                   w[8] * o.x() + w[9] * o.y() + w[10] * o.z() + w[11]),
+              Vec3(w[0] * d.x() + w[1] * d.y() + w[2] * d.z(),
+                   w[4] * d.x() + w[5] * d.y() + w[6] * d.z(),
+                   w[8] * d.x() + w[9] * d.y() + w[10] * d.z()),
+              r.time());
+
+    if (!prototype.Hit(local, tMin, tMax, rec)) {
+        return false;
+    }
+
+    // Normals go through the transpose of the inverse: dot(d, n) keeps its sign, so frontFace still holds
+    const Vec3 n = rec.normal;
+    rec.normal = unitVector(Vec3(w[0] * n.x() + w[4] * n.y() + w[8] * n.z(),
+                                 w[1] * n.x() + w[5] * n.y() + w[9] * n.z(),
+                                 w[2] * n.x() + w[6] * n.y() + w[10] * n.z()));
+    rec.p = r.point_at_parameter(rec.t);
+    if (material) {
+        rec.materialPtr = material;
+    }
+    return true;
+}
+
+// One placement of a shared prototype (a sphere group's BVH, any bounded Hittable), for lists and generic BVHs
+// Large counts of instances belong in an InstanceBvh, which stores them far more compactly
+class Instance : public Hittable {
+    private:
+        const Hittable* mPrototype;
+        // Keeps the prototype alive when given a shared one, empty when it lives in a Scene
+        shared_ptr<Hittable> mPrototypeOwner;
+        float mWorldToObject[12];
+        const Material* mMaterial;
+        Aabb mBox;
+        bool mBounded;
+
+    public:
+        Instance(const Hittable* prototype, const AffineTransform& objectToWorld, const Material* material = nullptr)
+            : mPrototype(prototype), mMaterial(material) {
+            objectToWorld.Inverse().Store(mWorldToObject);
+            Aabb box;
+            mBounded = prototype->BoundingBox(box);
+            if (mBounded) {
+                mBox = objectToWorld.Box(box);
+            }
+        }
+        Instance(shared_ptr<Hittable> prototype, const AffineTransform& objectToWorld, const Material* material = nullptr)
+            : Instance(prototype.get(), objectToWorld, material) {
+            mPrototypeOwner = prototype;
+        }
+
+        virtual bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const override {
+            return HitInstance(*mPrototype, mWorldToObject, mMaterial, r, tMin, tMax, rec);
+        }
+
+        virtual bool BoundingBox(Aabb& outputBox) const override {
+            outputBox = mBox;
+            return mBounded;
+        }
+};
+
+// 56 bytes per instance, whatever the size of its prototype
+struct InstanceRecord {
+    float worldToObject[12];
+    uint32_t prototype;
+    // Index in the material table, noMaterial keeps the prototype's materials
+    uint32_t material;
+};
+
+static_assert(sizeof(InstanceRecord) == 56, "InstanceRecord must stay 56 bytes");
+
+// Leaf storage of the top level of a two level hierarchy: instances refer to prototypes and materials by index,
+// each prototype being a bottom level structure (a SphereBvh for a group of spheres) built once however often it is used
+// Prototypes and materials are not owned, they must outlive the batch (a Scene's arena keeps them)
+class InstanceBatch {
+    public:
+        // Testing an instance traverses a whole prototype, small leaves keep the top level selective
+        static const int maxLeafSize = 2;
+        static const uint32_t noMaterial = 0xFFFFFFFFu;
+
+    private:
+        std::vector<InstanceRecord> mInstances;
+        std::vector<const Hittable*> mPrototypes;
+        std::vector<Aabb> mPrototypeBoxes;
+        std::vector<const Material*> mMaterials;
+
+    public:
+        InstanceBatch() {}
+
+        // The prototype must be bounded, returns its index for Add()
+        uint32_t AddPrototype(const Hittable* prototype) {
+            Aabb box;
+            prototype->BoundingBox(box);
+            mPrototypes.push_back(prototype);
+            mPrototypeBoxes.push_back(box);
+            return static_cast<uint32_t>(mPrototypes.size() - 1);
+        }
+
+        uint32_t AddMaterial(const Material* material) {
+            mMaterials.push_back(material);
+            return static_cast<uint32_t>(mMaterials.size() - 1);
+        }
+
+        void Add(uint32_t prototype, const AffineTransform& objectToWorld, uint32_t material = noMaterial) {
+            InstanceRecord record;
+            objectToWorld.Inverse().Store(record.worldToObject);
+            record.prototype = prototype;
+            record.material = material;
+            mInstances.push_back(record);
+        }
+
+        void Reserve(size_t count) { mInstances.reserve(count); }
+
+        size_t Size() const { return mInstances.size(); }
+        size_t PrototypeCount() const { return mPrototypes.size(); }
+
+        // Instances and tables, the prototypes themselves are counted by their owner
+        size_t MemoryFootprint() const {
+            return mInstances.size() * sizeof(InstanceRecord) + mPrototypes.size() * (sizeof(const Hittable*) + sizeof(Aabb))
+                + mMaterials.size() * sizeof(const Material*);
+        }
+
+        Aabb Box(size_t i) const {
+            const InstanceRecord& instance = mInstances[i];
+            return AffineTransform::Load(instance.worldToObject).Inverse().Box(mPrototypeBoxes[instance.prototype]);
+        }
+
+        InstanceBatch Reordered(const std::vector<size_t>& order) const {
+            InstanceBatch batch;
+            batch.mPrototypes = mPrototypes;
+            batch.mPrototypeBoxes = mPrototypeBoxes;
+            batch.mMaterials = mMaterials;
+            batch.mInstances.reserve(order.size());
+            for (size_t i : order) {
+                batch.mInstances.push_back(mInstances[i]);
+            }
+            return batch;
+        }
+
+        // Nearest hit among the instances [first, first + count[
+        bool HitRange(const Ray& r, size_t first, size_t count, Real tMin, Real tMax, HitRecord& rec) const {
+            bool hitAnything = false;
+            for (size_t i = first; i < first + count; i++) {
+                const InstanceRecord& instance = mInstances[i];
+                const Material* material = instance.material == noMaterial ? nullptr : mMaterials[instance.material];
+                if (HitInstance(*mPrototypes[instance.prototype], instance.worldToObject, material, r, tMin, tMax, rec)) {
+                    hitAnything = true;
+                    tMax = rec.t;
+                }
+            }
+            return hitAnything;
+        }
+};
+
+// Top level BVH over instances, each leaf hit descending into the instance's prototype
+using InstanceBvh = FlatBvhT<InstanceBatch>;
+
+#endif //INSTANCE_H
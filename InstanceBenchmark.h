@@ -0,0 +1,74 @@
+#ifndef INSTANCE_BENCHMARK_H
+#define INSTANCE_BENCHMARK_H
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "Camera.h"
+#include "ExampleScenes.h"
+#include "Framebuffer.h"
+#include "ImageDiff.h"
+#include "Instance.h"
+#include "Renderer.h"
+#include "SceneFile.h"
+#include "SphereBatch.h"
+
+// Memory and speed of InstancedScene() with its groups as instances under a two level hierarchy, against the same
+// spheres flattened into one SphereBvh. Frames are rendered at the renderer's size with samplesPerPixel samples
+void RunInstanceBenchmark(std::ostream& out, TileRenderer& renderer, const std::vector<size_t>& instanceCounts = { 10000, 100000, 1000000 },
+                          int samplesPerPixel = 8) {
+    using namespace std::chrono;
+    const RenderSettings settings = renderer.Settings();
+    RenderSettings fixed = settings;
+    fixed.adaptive = false;
+    fixed.samplesPerPixel = samplesPerPixel;
+    renderer.SetSettings(fixed);
+
+    double aspectRatio = double(fixed.imageWidth) / fixed.imageHeight;
+    Camera cam(Vec3(13, 2, 3), Vec3(0, 0, 0), Vec3(0, 1, 0), 20, aspectRatio, 0.0, 10.0);
+
+    out << "Instancing (" << fixed.imageWidth << "x" << fixed.imageHeight << ", " << samplesPerPixel << " spp, " << renderer.ThreadCount() << " threads):\n";
+    for (size_t count : instanceCounts) {
+        FloatImage images[2];
+        for (int instanced = 1; instanced >= 0; instanced--) {
+            size_t baseline = CurrentMemoryBytes();
+            auto start = steady_clock::now();
+            Scene scene = InstancedScene(count, instanced != 0);
+            // The instanced world is the ground and the top level BVH, the flat one needs a BVH over all its spheres
+            SphereBvh flat;
+            if (!instanced) {
+                flat = SphereBvh(scene.World());
+            }
+            const Hittable& world = instanced ? static_cast<const Hittable&>(scene.World()) : flat;
+            double buildMs = duration<double, std::milli>(steady_clock::now() - start).count();
+            size_t resident = CurrentMemoryBytes() - std::min(baseline, CurrentMemoryBytes());
+
+            double primaryRate = renderer.PrimaryRayRate(world, cam, false);
+            Framebuffer framebuffer(fixed.imageWidth, fixed.imageHeight);
+            start = steady_clock::now();
+            renderer.Render(world, cam, framebuffer);
+            double seconds = duration<double>(steady_clock::now() - start).count();
+            images[instanced] = ToFloatImage(framebuffer);
+
+            out << "\r  " << count << (instanced ? " instances: " : " flattened: ") << scene.World().objects.size() << " objects, build " << buildMs
+                << " ms, " << resident / (1024.0 * 1024.0) << " MiB resident (" << scene.ArenaBytes() / (1024.0 * 1024.0) << " MiB arena";
+            if (instanced) {
+                const InstanceBvh* top = dynamic_cast<const InstanceBvh*>(scene.World().objects.back().get());
+                out << ", " << top->MemoryFootprint() / (1024.0 * 1024.0) << " MiB top level";
+            }
+            else {
+                out << ", " << flat.MemoryFootprint() / (1024.0 * 1024.0) << " MiB BVH";
+            }
+            out << ") | primary " << primaryRate / 1e6 << " Mrays/s on one thread | paths "
+                << renderer.LastPathCounters().segments / seconds / 1e6 << " Mrays/s\n";
+        }
+
+        ImageDifference difference = CompareImages(images[1], images[0]);
+        out << "    instanced against flattened: RMSE " << difference.rmse << ", visibly different pixels " << difference.visiblePixelsPercent << "%\n";
+    }
+
+    renderer.SetSettings(settings);
+}
+
+#endif //INSTANCE_BENCHMARK_H
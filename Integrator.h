@@ -0,0 +1,199 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <cstdint>
+#include <iostream>
+
+#include "Utility.h"
+#include "Hittable.h"
+#include "Light.h"
+#include "Material.h"
+#include "Profiler.h"
+
+Vec3 SkyColor(const Ray& r) {
+    Vec3 unit_direction = unitVector(r.direction()); // -> unitVector : transformation en vecteur unitaire
+    Real t = Real(0.5)*(unit_direction.y() + 1);
+
+    return (1.0 - t)*Vec3(1.0, 1.0, 1.0) + t*Vec3(0.5, 0.7, 1.0);
+}
+
+// How paths are terminated
+struct PathSettings {
+    int maxDepth = 50;
+    // Russian roulette may end paths after this many bounces, negative to disable it
+    int rouletteMinDepth = 3;
+    // Emitters sampled with a shadow ray at every diffuse bounce, null (or empty) to only find them by bouncing
+    const LightList* lights = nullptr;
+    // Scale of the sky gradient, 0 for scenes only lit by their emitters
+    Real skyIntensity = 1;
+};
+
+// Filled by each thread on its own and merged once rendering is over
+struct PathCounters {
+    uint64_t paths = 0;
+    // Rays traced along the paths, primary rays included
+    uint64_t segments = 0;
+    uint64_t rouletteKills = 0;
+    // Rays toward the lights, not part of segments
+    uint64_t shadowRays = 0;
+
+    void Merge(const PathCounters& other) {
+        paths += other.paths;
+        segments += other.segments;
+        rouletteKills += other.rouletteKills;
+        shadowRays += other.shadowRays;
+    }
+};
+
+// Unbiased russian roulette: the path survives with a probability following its throughput, survivors are
+// weighted up by the same amount to make up for the killed ones
+inline bool SurviveRoulette(Vec3& throughput) {
+    Real survival = std::fmax(throughput.x(), std::fmax(throughput.y(), throughput.z()));
+    if (survival >= 1.0) {
+        return true;
+    }
+    if (RandomDouble() >= survival) {
+        return false;
+    }
+
+    throughput /= survival;
+    return true;
+}
+
+// Weight of a strategy of density pdf against another one of density otherPdf for the same path (Veach's power heuristic)
+inline Real PowerHeuristic(Real pdf, Real otherPdf) {
+    Real a = pdf * pdf;
+    Real b = otherPdf * otherPdf;
+    return a + b > 0 ? a / (a + b) : 0;
+}
+
+// Light of the surface hit by ray, for an emitter the part light sampling didn't already account for
+// bsdfPdf is the density of the bounce that chose ray when light sampling ran at that bounce too, 0 otherwise
+// (camera rays, specular bounces, no light sampling): the emitter is then only reachable this way and keeps all its light
+inline Vec3 EmittedLight(const Ray& ray, const HitRecord& rec, Real bsdfPdf, const LightList* lights) {
+    Vec3 emitted = EmittedMaterial(rec.materialPtr, rec);
+    if (bsdfPdf > 0 && rec.materialPtr->mKind == MaterialKind::DiffuseLight) {
+        emitted *= PowerHeuristic(bsdfPdf, lights->Pdf(ray, rec));
+    }
+    return emitted;
+}
+
+// Next event estimation at a diffuse hit: a direction toward one light and a shadow ray, weighted against the chance
+// of the cosine bounce finding the same point of the light
+Vec3 SampleDirectLight(const Hittable& world, const LightList& lights, const Ray& ray, const HitRecord& rec, const Vec3& albedo, PathCounters& counters) {
+    LightSample sample;
+    if (!lights.Sample(rec.p, ray.time(), sample)) {
+        return Vec3(0, 0, 0);
+    }
+    Real cosine = dot(sample.direction, rec.normal);
+    if (cosine <= 0) {
+        return Vec3(0, 0, 0);
+    }
+
+    counters.shadowRays++;
+    Ray shadow(rec.p, sample.direction, ray.time());
+    HitRecord lightRec;
+    bool hit;
+    {
+        PROFILE_STAGE(Intersect);
+        hit = world.Hit(shadow, 0.001, infinity, lightRec);
+    }
+    if (!hit || !lights.IsOn(sample.light, lightRec, ray.time())) {
+        return Vec3(0, 0, 0);
+    }
+
+    // albedo / pi * cosine / pdf, the cosine bounce's density being cosine / pi
+    Real bsdfPdf = cosine / Real(pi);
+    return EmittedMaterial(lightRec.materialPtr, lightRec) * albedo * (bsdfPdf / sample.pdf * PowerHeuristic(sample.pdf, bsdfPdf));
+}
+
+// Follows the path starting with r, iteratively so the stack doesn't grow with the depth
+// firstHit, when given, is the already known intersection of r (packet tracing)
+Vec3 TracePath(const Ray& r, const Hittable& world, const PathSettings& settings, PathCounters& counters, const HitRecord* firstHit = nullptr) {
+    Vec3 color(0.0, 0.0, 0.0);
+    Vec3 throughput(1.0, 1.0, 1.0);
+    Ray ray = r;
+    HitRecord rec;
+    const LightList* lights = settings.lights && !settings.lights->Empty() ? settings.lights : nullptr;
+    // Density of the bounce that chose ray, see EmittedLight()
+    Real bsdfPdf = 0;
+
+    counters.paths++;
+    PROFILE_PATH();
+
+    // If we've exceed the ray bounce limit, no more light is gathered
+    for (int bounce = 0; bounce < settings.maxDepth; bounce++) {
+        counters.segments++;
+
+        if (firstHit) {
+            rec = *firstHit;
+            firstHit = nullptr;
+        }
+        else {
+            bool hit;
+            {
+                PROFILE_STAGE(Intersect);
+                hit = world.Hit(ray, 0.001, infinity, rec);
+            }
+            if (!hit) {
+                // Display the sky
+                return color + throughput * (settings.skyIntensity * SkyColor(ray));
+            }
+        }
+        PROFILE_BOUNCE();
+
+        color += throughput * EmittedLight(ray, rec, bsdfPdf, lights);
+
+        bool sampleLights = lights && rec.materialPtr->mKind == MaterialKind::Lambertian;
+        if (sampleLights) {
+            color += throughput * SampleDirectLight(world, *lights, ray, rec, static_cast<const Lambertian*>(rec.materialPtr)->mAlbedo, counters);
+        }
+
+        Ray scattered;
+        Vec3 attenuation;
+        bool scatters;
+        {
+            PROFILE_STAGE(Scatter);
+            scatters = ScatterMaterial(rec.materialPtr, ray, rec, attenuation, scattered);
+        }
+
+        // Absorbed, or an emitter: nothing comes from further along
+        if (!scatters) {
+            break;
+        }
+        throughput *= attenuation;
+        bsdfPdf = sampleLights ? std::fmax(Real(0), dot(scattered.direction(), rec.normal)) / Real(pi) : 0;
+        ray = scattered;
+
+        if (settings.rouletteMinDepth >= 0 && bounce + 1 >= settings.rouletteMinDepth && !SurviveRoulette(throughput)) {
+            counters.rouletteKills++;
+            break;
+        }
+    }
+
+    return color;
+}
+
+Vec3 RayColor(const Ray& r, const Hittable& world, int depth) {
+    PathSettings settings;
+    settings.maxDepth = depth;
+    settings.rouletteMinDepth = -1;
+    PathCounters counters;
+
+    return TracePath(r, world, settings, counters);
+}
+
+void PrintPathReport(std::ostream& out, const PathCounters& counters) {
+    if (counters.paths == 0) {
+        return;
+    }
+
+    out << "Paths: " << counters.paths << ", " << double(counters.segments) / counters.paths << " rays per path"
+        << ", " << 100.0 * counters.rouletteKills / counters.paths << "% ended by russian roulette";
+    if (counters.shadowRays > 0) {
+        out << ", " << double(counters.shadowRays) / counters.paths << " shadow rays per path";
+    }
+    out << "\n";
+}
+
+#endif //INTEGRATOR_H
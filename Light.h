@@ -0,0 +1,165 @@
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "Utility.h"
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Material.h"
+#include "Sampling.h"
+#include "Sphere.h"
+#include "SphereBatch.h"
+
+// An emitting sphere, as the scene has it (center at shutter open and its motion over the shutter interval)
+struct SphereLight {
+    Vec3 center;
+    Vec3 motion;
+    Real radius;
+    const DiffuseLight* material;
+
+    Vec3 CenterAt(Real time) const { return center + time * motion; }
+};
+
+// Direction toward a light picked by LightList::Sample(), and the density of the whole choice in solid angle
+struct LightSample {
+    Vec3 direction;
+    Real pdf;
+    size_t light;
+};
+
+// The emitters of a scene, sampled explicitly from the shading points (next event estimation)
+// Only DiffuseLight spheres are listed: other emitters (user materials, hollow spheres, instances) are still found
+// by the paths bouncing into them, their light is then not weighted against light sampling
+class LightList {
+    private:
+        std::vector<SphereLight> mLights;
+        // Lights are picked in proportion to their power (luminance times area), running sums of it
+        std::vector<Real> mCdf;
+        Real mTotalPower = 0;
+        // Lights of every emitting material, so an emitter hit only checks the spheres it can be (usually one)
+        std::unordered_map<const Material*, std::vector<size_t>> mLightsOfMaterial;
+
+    public:
+        LightList() {}
+
+        // Emitting spheres among the objects of a list (the other objects are ignored)
+        explicit LightList(const HittableList& world) {
+            for (const auto& object : world.objects) {
+                const Sphere* sphere = dynamic_cast<const Sphere*>(object.get());
+                if (sphere) {
+                    Add(sphere->mCenter, sphere->mMotion, sphere->mRadius, sphere->mMatPtr);
+                }
+            }
+        }
+
+        // Emitting spheres of a batch, taken again after the animation moved them
+        explicit LightList(const SphereBatch& spheres) {
+            for (size_t i = 0; i < spheres.Size(); i++) {
+                Add(spheres.Center(i), spheres.Motion(i), spheres.Radius(i), spheres.MaterialOf(i));
+            }
+        }
+
+        // Ignored unless mat is a DiffuseLight giving some light and the sphere isn't hollow
+        void Add(const Vec3& center, const Vec3& motion, Real radius, const Material* mat) {
+            if (!mat || mat->mKind != MaterialKind::DiffuseLight || radius <= 0) {
+                return;
+            }
+            const DiffuseLight* light = static_cast<const DiffuseLight*>(mat);
+            const Vec3& e = light->mEmit;
+            Real power = (Real(0.2126) * e.x() + Real(0.7152) * e.y() + Real(0.0722) * e.z()) * radius * radius;
+            if (power <= 0) {
+                return;
+            }
+
+            mLightsOfMaterial[light].push_back(mLights.size());
+            mLights.push_back({ center, motion, radius, light });
+            mTotalPower += power;
+            mCdf.push_back(mTotalPower);
+        }
+
+        bool Empty() const { return mLights.empty(); }
+        size_t Size() const { return mLights.size(); }
+        const SphereLight& operator[](size_t i) const { return mLights[i]; }
+
+        // Picks a light, then a direction from p toward it uniformly within the cone it covers
+        // Always draws three numbers, returns false when p is inside the light (nothing to aim at)
+        bool Sample(const Vec3& p, Real time, LightSample& sample) const {
+            Real u = RandomDouble();
+            Real u1 = RandomDouble();
+            Real u2 = RandomDouble();
+
+            size_t i = std::min(mLights.size() - 1, size_t(std::upper_bound(mCdf.begin(), mCdf.end(), u * mTotalPower) - mCdf.begin()));
+            const SphereLight& light = mLights[i];
+
+            Vec3 toCenter = light.CenterAt(time) - p;
+            Real distanceSquared = toCenter.squaredLength();
+            Real sinSquared = light.radius * light.radius / distanceSquared;
+            if (sinSquared >= 1) {
+                return false;
+            }
+            Real oneMinusCosMax = OneMinusCosMax(sinSquared);
+
+            // Uniform in solid angle: 1 - cos(theta) uniform in [0, 1 - cosMax]
+            Real oneMinusCos = u1 * oneMinusCosMax;
+            Real sinTheta = std::sqrt(std::fmax(Real(0), oneMinusCos * (2 - oneMinusCos)));
+            Real phi = Real(2 * pi) * u2;
+            Vec3 axis = toCenter / std::sqrt(distanceSquared);
+            Vec3 tangent, bitangent;
+            OrthonormalBasis(axis, tangent, bitangent);
+
+            sample.direction = sinTheta * std::cos(phi) * tangent + sinTheta * std::sin(phi) * bitangent + (1 - oneMinusCos) * axis;
+            sample.pdf = Selection(i) / (Real(2 * pi) * oneMinusCosMax);
+            sample.light = i;
+            return true;
+        }
+
+        // Whether rec, hit along a ray of time time, lies on light i
+        bool IsOn(size_t i, const HitRecord& rec, Real time) const {
+            const SphereLight& light = mLights[i];
+            return rec.materialPtr == light.material && std::fabs((rec.p - light.CenterAt(time)).length() - light.radius) <= Real(1e-3) * (light.radius + 1);
+        }
+
+        // Density of Sample() choosing the direction of ray from its origin and reaching the emitter hit in rec,
+        // 0 for emitters that aren't listed
+        Real Pdf(const Ray& ray, const HitRecord& rec) const {
+            auto candidates = mLightsOfMaterial.find(rec.materialPtr);
+            if (candidates == mLightsOfMaterial.end()) {
+                return 0;
+            }
+            for (size_t i : candidates->second) {
+                if (!IsOn(i, rec, ray.time())) {
+                    continue;
+                }
+                const SphereLight& light = mLights[i];
+                Real sinSquared = light.radius * light.radius / (light.CenterAt(ray.time()) - ray.origin()).squaredLength();
+                if (sinSquared >= 1) {
+                    return 0;
+                }
+                return Selection(i) / (Real(2 * pi) * OneMinusCosMax(sinSquared));
+            }
+            return 0;
+        }
+
+    private:
+        Real Selection(size_t i) const { return (mCdf[i] - (i > 0 ? mCdf[i - 1] : Real(0))) / mTotalPower; }
+
+        // 1 - cos of the half angle of the cone, written so small lights far away don't cancel to 0
+        static Real OneMinusCosMax(Real sinSquared) {
+            return sinSquared / (1 + std::sqrt(1 - sinSquared));
+        }
+};
+
+void PrintLightReport(std::ostream& out, const LightList& lights) {
+    out << "Lights: " << lights.Size() << " emitting spheres sampled";
+    if (lights.Empty()) {
+        out << " (paths only find emitters by bouncing into them)";
+    }
+    out << "\n";
+}
+
+#endif //LIGHT_H
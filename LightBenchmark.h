@@ -0,0 +1,83 @@
+#ifndef LIGHT_BENCHMARK_H
+#define LIGHT_BENCHMARK_H
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "Camera.h"
+#include "ExampleScenes.h"
+#include "Framebuffer.h"
+#include "ImageDiff.h"
+#include "Light.h"
+#include "Renderer.h"
+#include "SphereBatch.h"
+
+// Convergence of SmallLightScene() with light sampling against paths that only find the lights by bouncing into them,
+// both measured against a light sampled reference of referenceSamples spp with another seed (so its samples are
+// not the ones of the frames compared to it). Frames are rendered at the renderer's size, without adaptive sampling
+void RunLightBenchmark(std::ostream& out, TileRenderer& renderer, const std::vector<int>& sampleCounts = { 4, 16, 64, 256 },
+                       int referenceSamples = 1024) {
+    using namespace std::chrono;
+    const RenderSettings settings = renderer.Settings();
+    const LightList* previousLights = renderer.Lights();
+    RenderSettings fixed = settings;
+    fixed.adaptive = false;
+    fixed.skyIntensity = 0.0;
+    int width = fixed.imageWidth;
+    int height = fixed.imageHeight;
+
+    Scene scene = SmallLightScene();
+    SphereBvh bvh(scene.World());
+    LightList lights(scene.World());
+    renderer.SetLights(&lights);
+    Camera cam(Vec3(13, 2, 3), Vec3(0, 0, -1), Vec3(0, 1, 0), 20, double(width) / height, 0.1, 10.0);
+
+    auto render = [&](int samples, bool sampleLights, uint64_t seed, double& seconds) {
+        RenderSettings s = fixed;
+        s.samplesPerPixel = samples;
+        s.sampleLights = sampleLights;
+        s.seed = seed;
+        renderer.SetSettings(s);
+        Framebuffer framebuffer(width, height);
+        auto start = steady_clock::now();
+        renderer.Render(bvh, cam, framebuffer);
+        seconds = duration<double>(steady_clock::now() - start).count();
+        return ToFloatImage(framebuffer);
+    };
+
+    double seconds = 0.0;
+    FloatImage reference = render(referenceSamples, true, settings.seed + 1, seconds);
+    out << "\rSmall lights (" << lights.Size() << " lights, " << width << "x" << height << ", " << renderer.ThreadCount()
+        << " threads) against " << referenceSamples << " spp with light sampling (" << seconds << " s):\n";
+
+    std::vector<double> sampledErrors;
+    std::vector<double> bouncedErrors;
+    for (int samples : sampleCounts) {
+        double sampledSeconds = 0.0;
+        double bouncedSeconds = 0.0;
+        ImageDifference sampled = CompareImages(render(samples, true, settings.seed, sampledSeconds), reference);
+        ImageDifference bounced = CompareImages(render(samples, false, settings.seed, bouncedSeconds), reference);
+        sampledErrors.push_back(sampled.rmse);
+        bouncedErrors.push_back(bounced.rmse);
+        out << "\r  " << samples << " spp: light sampling RMSE " << sampled.rmse << " (" << sampledSeconds << " s) | bouncing only RMSE "
+            << bounced.rmse << " (" << bouncedSeconds << " s)\n";
+    }
+
+    // Samples bouncing only needs to get as close to the reference as light sampling does with the fewest samples
+    for (size_t i = 0; i < sampleCounts.size(); i++) {
+        if (bouncedErrors[i] <= sampledErrors.front()) {
+            out << "  Bouncing only needs " << sampleCounts[i] << " spp to match light sampling at " << sampleCounts.front() << " spp\n";
+            break;
+        }
+        if (i + 1 == sampleCounts.size()) {
+            out << "  Bouncing only at " << sampleCounts.back() << " spp is still further from the reference than light sampling at "
+                << sampleCounts.front() << " spp\n";
+        }
+    }
+
+    renderer.SetLights(previousLights);
+    renderer.SetSettings(settings);
+}
+
+#endif //LIGHT_BENCHMARK_H
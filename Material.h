@@ -3,70 +3,92 @@
 
 #include "Utility.h"
 #include "Hittable.h"
+#include "Profiler.h"
+#include "Sampling.h"
 
-struct HitRecord;
+// Lets the integrators dispatch Scatter without a virtual call, user materials are Other
+// The built-in materials are final, so no user class can inherit a tag whose dispatch would bypass its overrides
+enum class MaterialKind { Lambertian, Metal, Dielectric, DiffuseLight, Other };
 
 class Material {
     public:
+        MaterialKind mKind;
+
+    public:
+        Material() : mKind(MaterialKind::Other) {}
+
         virtual bool Scatter(const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const = 0;
+
+        // Surface color seen by the denoiser's albedo buffer, white for materials that don't tint (glass)
+        virtual Vec3 Albedo() const { return Vec3(1, 1, 1); }
+
+        // Radiance leaving the surface by itself, black for everything but the emitters
+        virtual Vec3 Emitted(const HitRecord&) const { return Vec3(0, 0, 0); }
+
+    protected:
+        // Only for the built-in materials below
+        explicit Material(MaterialKind kind) : mKind(kind) {}
 };
 
-class Lambertian : public Material {
+class Lambertian final : public Material {
     public:
         Vec3 mAlbedo;
     
     public:
-        Lambertian(const Vec3& albedo) : mAlbedo(albedo) {}
+        Lambertian(const Vec3& albedo) : Material(MaterialKind::Lambertian), mAlbedo(albedo) {}
 
-        virtual bool Scatter(const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override {
-            Vec3 scatterDirection = rec.normal + RandomUnitVector();
+        virtual Vec3 Albedo() const override { return mAlbedo; }
 
-            // Catch zero scatter direction vector
-             if (scatterDirection.NearZero()) {
-                scatterDirection = rec.normal;
-             }
+        virtual bool Scatter(const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override {
+            // Cosine weighted around the normal, of unit length and never zero: no normalization, no degenerate case
+            Vec3 scatterDirection = RandomCosineDirection(rec.normal);
 
-            scattered = Ray(rec.p, scatterDirection);
+            scattered = Ray(rec.p, scatterDirection, rIn.time());
             attenuation = mAlbedo;
             
+            PROFILE_SCATTER(MaterialKind::Lambertian, true);
             return true;
         }
 };
 
-class Metal : public Material {
+class Metal final : public Material {
     public:
         Vec3 mAlbedo;
-        double mFuzzyness;
+        Real mFuzzyness;
     
     public:
-        Metal(const Vec3 albedo, double fuzzyness) : mAlbedo(albedo), mFuzzyness(fuzzyness) {}
+        Metal(const Vec3 albedo, double fuzzyness) : Material(MaterialKind::Metal), mAlbedo(albedo), mFuzzyness(fuzzyness) {}
+
+        virtual Vec3 Albedo() const override { return mAlbedo; }
 
         virtual bool Scatter(const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override {
             Vec3 reflected = reflect(unitVector(rIn.direction()), rec.normal);
-            scattered = Ray(rec.p, reflected + mFuzzyness*RandomInUnitSphere());
+            scattered = Ray(rec.p, reflected + mFuzzyness*RandomInUnitSphere(), rIn.time());
             //                                 ^ randomize the reflected direction by using a sphere and thus, choosing a new endpoint for the ray
             attenuation = mAlbedo;
 
-            return (dot(scattered.direction(), rec.normal) > 0);
+            bool scatters = dot(scattered.direction(), rec.normal) > 0;
+            PROFILE_SCATTER(MaterialKind::Metal, scatters);
+            return scatters;
         }
 };
 
-class Dielectric : public Material {
+class Dielectric final : public Material {
     public:
         // Index of refraction
-        double mIR;
+        Real mIR;
 
     public:
-        Dielectric(double iR) : mIR(iR) {}
+        Dielectric(double iR) : Material(MaterialKind::Dielectric), mIR(iR) {}
 
         virtual bool Scatter(const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) const override {
             attenuation = Vec3(1.0, 1.0, 1.0);
-            double refractionRatio = rec.frontFace ? (1.0 / mIR) : mIR;
+            Real refractionRatio = rec.frontFace ? (1 / mIR) : mIR;
 
             Vec3 unitDirection = unitVector(rIn.direction());
 
-            double cosTheta = fmin(dot(-unitDirection, rec.normal), 1.0);
-            double sinTheta = sqrt(1.0 - cosTheta*cosTheta);
+            Real cosTheta = std::fmin(dot(-unitDirection, rec.normal), Real(1));
+            Real sinTheta = sqrt(1 - cosTheta*cosTheta);
 
             Vec3 direction;
 
@@ -78,21 +100,71 @@ class Dielectric : public Material {
                 direction = Refract(unitDirection, rec.normal, refractionRatio);
             }
 
-            scattered = Ray(rec.p, direction);
+            scattered = Ray(rec.p, direction, rIn.time());
 
+            PROFILE_SCATTER(MaterialKind::Dielectric, true);
             return true;
         }
 
         private:
-            static double Reflectance(double cosTheta, double refIndex) {
+            static Real Reflectance(Real cosTheta, Real refIndex) {
                 // Use Shlick's approximation for reflectance
                 // R(Theta) becomes R0 when reflection coefficient for light incoming is parallel to the normal -> r0
 
-                double r0 = (1 - refIndex) / (1 + refIndex);
+                Real r0 = (1 - refIndex) / (1 + refIndex);
                 r0 = r0 * r0;
 
-                return r0 + (1 - r0)*pow((1 - cosTheta), 5);
+                return r0 + (1 - r0)*std::pow(1 - cosTheta, Real(5));
         }
 };
 
+// Emits the same radiance in every direction from the front of its surface, and reflects nothing
+class DiffuseLight final : public Material {
+    public:
+        Vec3 mEmit;
+
+    public:
+        DiffuseLight(const Vec3& emit) : Material(MaterialKind::DiffuseLight), mEmit(emit) {}
+
+        virtual Vec3 Emitted(const HitRecord& rec) const override { return rec.frontFace ? mEmit : Vec3(0, 0, 0); }
+
+        virtual bool Scatter(const Ray&, const HitRecord&, Vec3&, Ray&) const override {
+            PROFILE_SCATTER(MaterialKind::DiffuseLight, false);
+            return false;
+        }
+};
+
+// Closed dispatch over the built-in materials: the tag picks the class and the qualified call is direct, so the
+// compiler can inline Scatter into the path loop. Only user materials (Other) still go through the virtual call
+// Define RAYTRACER_VIRTUAL_SCATTER to always call the virtual (to measure the difference)
+inline bool ScatterMaterial(const Material* mat, const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) {
+#ifndef RAYTRACER_VIRTUAL_SCATTER
+    switch (mat->mKind) {
+        case MaterialKind::Lambertian:
+            return static_cast<const Lambertian*>(mat)->Lambertian::Scatter(rIn, rec, attenuation, scattered);
+        case MaterialKind::Metal:
+            return static_cast<const Metal*>(mat)->Metal::Scatter(rIn, rec, attenuation, scattered);
+        case MaterialKind::Dielectric:
+            return static_cast<const Dielectric*>(mat)->Dielectric::Scatter(rIn, rec, attenuation, scattered);
+        case MaterialKind::DiffuseLight:
+            return static_cast<const DiffuseLight*>(mat)->DiffuseLight::Scatter(rIn, rec, attenuation, scattered);
+        case MaterialKind::Other:
+            break;
+    }
+#endif
+    return mat->Scatter(rIn, rec, attenuation, scattered);
+}
+
+// Same dispatch for the emission, checked at every hit: only emitters and user materials pay for a call
+inline Vec3 EmittedMaterial(const Material* mat, const HitRecord& rec) {
+    switch (mat->mKind) {
+        case MaterialKind::DiffuseLight:
+            return static_cast<const DiffuseLight*>(mat)->DiffuseLight::Emitted(rec);
+        case MaterialKind::Other:
+            return mat->Emitted(rec);
+        default:
+            return Vec3(0, 0, 0);
+    }
+}
+
 #endif
\ No newline at end of file
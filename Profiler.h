@@ -0,0 +1,221 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <iostream>
+
+// Hot path counters, built only with RAYTRACER_PROFILE: the PROFILE_ macros expand to nothing otherwise
+// Every thread increments its own block (no atomics), blocks are summed once rendering is over
+
+#ifdef RAYTRACER_PROFILE
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define RAYTRACER_PROFILE_RDTSC
+#endif
+
+// Stages timed inside TracePath(), Path covers the whole path so the rest is Path - Intersect - Scatter
+enum class ProfileStage { Path, Intersect, Scatter, Count };
+
+struct ProfileCounters {
+    // Same order as MaterialKind
+    static const int materialKinds = 5;
+    // Paths of more bounces end up in the last bucket
+    static const int bounceBuckets = 16;
+
+    uint64_t listCalls = 0;
+    uint64_t listHits = 0;
+    uint64_t sphereCalls = 0;
+    uint64_t sphereHits = 0;
+    uint64_t scatterCalls[materialKinds] = {};
+    uint64_t scatterAbsorbed[materialKinds] = {};
+    uint64_t paths = 0;
+    uint64_t bounces[bounceBuckets] = {};
+    uint64_t stageTicks[static_cast<int>(ProfileStage::Count)] = {};
+
+    void Merge(const ProfileCounters& other) {
+        listCalls += other.listCalls;
+        listHits += other.listHits;
+        sphereCalls += other.sphereCalls;
+        sphereHits += other.sphereHits;
+        for (int i = 0; i < materialKinds; i++) {
+            scatterCalls[i] += other.scatterCalls[i];
+            scatterAbsorbed[i] += other.scatterAbsorbed[i];
+        }
+        paths += other.paths;
+        for (int i = 0; i < bounceBuckets; i++) {
+            bounces[i] += other.bounces[i];
+        }
+        for (int i = 0; i < static_cast<int>(ProfileStage::Count); i++) {
+            stageTicks[i] += other.stageTicks[i];
+        }
+    }
+};
+
+inline uint64_t ProfileTicks() {
+#ifdef RAYTRACER_PROFILE_RDTSC
+    return __rdtsc();
+#else
+    return static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+class ProfileRegistry {
+    private:
+        std::mutex mMutex;
+        // Blocks outlive their thread so the counts of joined threads are kept
+        std::vector<std::unique_ptr<ProfileCounters>> mBlocks;
+        // Ticks are converted to time with the rate seen since the last Reset()
+        uint64_t mStartTicks = ProfileTicks();
+        std::chrono::steady_clock::time_point mStartTime = std::chrono::steady_clock::now();
+
+    public:
+        static ProfileRegistry& Instance() {
+            static ProfileRegistry registry;
+            return registry;
+        }
+
+        static ProfileCounters& Local() {
+            thread_local ProfileCounters* counters = Instance().NewBlock();
+            return *counters;
+        }
+
+        ProfileCounters* NewBlock() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBlocks.emplace_back(new ProfileCounters());
+            return mBlocks.back().get();
+        }
+
+        // Not synchronized with running threads, call it when no thread is tracing
+        ProfileCounters Total() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ProfileCounters total;
+            for (const auto& block : mBlocks) {
+                total.Merge(*block);
+            }
+            return total;
+        }
+
+        void Reset() {
+            std::lock_guard<std::mutex> lock(mMutex);
+            for (const auto& block : mBlocks) {
+                *block = ProfileCounters();
+            }
+            mStartTicks = ProfileTicks();
+            mStartTime = std::chrono::steady_clock::now();
+        }
+
+        double TicksPerSecond() {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStartTime).count();
+            return seconds > 0.0 ? (ProfileTicks() - mStartTicks) / seconds : 0.0;
+        }
+};
+
+// Adds the ticks spent in its scope to one stage
+class ProfileStageScope {
+    private:
+        int mStage;
+        uint64_t mStart;
+
+    public:
+        explicit ProfileStageScope(ProfileStage stage) : mStage(static_cast<int>(stage)), mStart(ProfileTicks()) {}
+        ~ProfileStageScope() { ProfileRegistry::Local().stageTicks[mStage] += ProfileTicks() - mStart; }
+};
+
+// One path: its time and, once it ends, its bounce count
+class ProfilePathScope {
+    public:
+        int bounces = 0;
+
+    private:
+        ProfileStageScope mStage;
+
+    public:
+        ProfilePathScope() : mStage(ProfileStage::Path) {}
+        ~ProfilePathScope() {
+            ProfileCounters& counters = ProfileRegistry::Local();
+            counters.paths++;
+            counters.bounces[bounces < ProfileCounters::bounceBuckets ? bounces : ProfileCounters::bounceBuckets - 1]++;
+        }
+};
+
+#define PROFILE_COUNT(counter) (ProfileRegistry::Local().counter++)
+#define PROFILE_SCATTER(kind, scattered) \
+    do { \
+        ProfileCounters& profileCounters = ProfileRegistry::Local(); \
+        profileCounters.scatterCalls[static_cast<int>(kind)]++; \
+        if (!(scattered)) profileCounters.scatterAbsorbed[static_cast<int>(kind)]++; \
+    } while (false)
+#define PROFILE_STAGE(stage) ProfileStageScope profileStage##stage(ProfileStage::stage)
+#define PROFILE_PATH() ProfilePathScope profilePath
+#define PROFILE_BOUNCE() (profilePath.bounces++)
+
+inline void ResetProfile() {
+    ProfileRegistry::Instance().Reset();
+}
+
+inline void PrintProfileReport(std::ostream& out) {
+    ProfileRegistry& registry = ProfileRegistry::Instance();
+    double ticksPerMs = registry.TicksPerSecond() / 1000.0;
+    ProfileCounters c = registry.Total();
+
+    out << "Profile:\n";
+    if (c.listCalls > 0) {
+        out << "  HittableList::Hit " << c.listCalls << " calls, " << 100.0 * c.listHits / c.listCalls << "% hits\n";
+    }
+    if (c.sphereCalls > 0) {
+        out << "  Sphere hits " << c.sphereCalls << " calls, " << 100.0 * c.sphereHits / c.sphereCalls << "% hits\n";
+    }
+
+    const char* materialNames[ProfileCounters::materialKinds] = { "Lambertian", "Metal", "Dielectric", "DiffuseLight", "Other" };
+    for (int i = 0; i < ProfileCounters::materialKinds; i++) {
+        if (c.scatterCalls[i] > 0) {
+            out << "  " << materialNames[i] << "::Scatter " << c.scatterCalls[i] << " calls, "
+                << 100.0 * c.scatterAbsorbed[i] / c.scatterCalls[i] << "% absorbed\n";
+        }
+    }
+
+    if (c.paths > 0) {
+        out << "  Bounces per path:";
+        for (int i = 0; i < ProfileCounters::bounceBuckets; i++) {
+            if (c.bounces[i] > 0) {
+                out << " " << i << (i == ProfileCounters::bounceBuckets - 1 ? "+" : "") << ": " << 100.0 * c.bounces[i] / c.paths << "%";
+            }
+        }
+        out << "\n";
+
+        // Summed over the threads
+        uint64_t path = c.stageTicks[static_cast<int>(ProfileStage::Path)];
+        uint64_t intersect = c.stageTicks[static_cast<int>(ProfileStage::Intersect)];
+        uint64_t scatter = c.stageTicks[static_cast<int>(ProfileStage::Scatter)];
+        uint64_t other = path > intersect + scatter ? path - intersect - scatter : 0;
+        if (path > 0 && ticksPerMs > 0.0) {
+            out << "  Path time " << path / ticksPerMs << " ms | intersect " << 100.0 * intersect / path << "% | scatter "
+                << 100.0 * scatter / path << "% | other " << 100.0 * other / path << "%\n";
+        }
+    }
+}
+
+#else
+
+#define PROFILE_COUNT(counter) ((void)0)
+#define PROFILE_SCATTER(kind, scattered) ((void)0)
+#define PROFILE_STAGE(stage) ((void)0)
+#define PROFILE_PATH() ((void)0)
+#define PROFILE_BOUNCE() ((void)0)
+
+inline void ResetProfile() {}
+inline void PrintProfileReport(std::ostream&) {}
+
+#endif
+
+#endif //PROFILER_H
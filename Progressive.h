@@ -0,0 +1,202 @@
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Framebuffer.h"
+#include "ImageWriter.h"
+#include "Renderer.h"
+
+struct ProgressiveSettings {
+    // Samples per pixel added by every pass
+    int passSamples = 16;
+    // Empty to never checkpoint, the checkpoint is removed once the render is complete
+    std::string checkpointPath = "render.checkpoint";
+    int checkpointEvery = 1;
+    // Empty for no preview, rewritten after every previewEvery passes while the render goes on
+    std::string previewPath = "preview.ppm";
+    int previewEvery = 1;
+    // Scene, frame and camera rendered, so the checkpoint of another one isn't blended in
+    uint64_t sceneHash = 0;
+};
+
+// What a checkpoint must match to be resumed, plus where the render was
+// Samples reseed the generator from (seed, pixel, sample index), so the seed and the sample counts are the whole random state
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t width;
+    int32_t height;
+    int32_t samplesPerPixel;
+    int32_t maxDepth;
+    int32_t rouletteMinDepth;
+    uint64_t seed;
+    // First sample of the next pass
+    int32_t nextSample;
+    // sizeof(Vec3), the sums of a float build can't be resumed by a double (or SIMD Vec3) build
+    int32_t pixelSize;
+    // SamplerKind, samples of different sequences don't add up to one estimate
+    int32_t sampler;
+    // Light sampling and the sky change the estimate of a path (the sky even its expected value)
+    int32_t sampleLights;
+    double skyIntensity;
+    // ProgressiveSettings::sceneHash
+    uint64_t sceneHash;
+
+    // 2: sampler field, and the analytical sample mappings changed every path
+    // 3: light sampling and sky fields, absorbed paths now end instead of bouncing on
+    // 4: scene hash
+    static const uint32_t currentVersion = 4;
+
+    static CheckpointHeader For(const RenderSettings& settings, int nextSample, uint64_t sceneHash) {
+        CheckpointHeader header;
+        std::memcpy(header.magic, "RTCKPT\0\0", sizeof(header.magic));
+        header.version = currentVersion;
+        header.width = settings.imageWidth;
+        header.height = settings.imageHeight;
+        header.samplesPerPixel = settings.samplesPerPixel;
+        header.maxDepth = settings.maxDepth;
+        header.rouletteMinDepth = settings.rouletteMinDepth;
+        header.seed = settings.seed;
+        header.nextSample = nextSample;
+        header.pixelSize = static_cast<int32_t>(sizeof(Vec3));
+        header.sampler = static_cast<int32_t>(settings.sampler);
+        header.sampleLights = settings.sampleLights ? 1 : 0;
+        header.skyIntensity = settings.skyIntensity;
+        header.sceneHash = sceneHash;
+        return header;
+    }
+
+    bool SameRender(const CheckpointHeader& other) const {
+        return std::memcmp(magic, other.magic, sizeof(magic)) == 0 && version == other.version
+            && width == other.width && height == other.height && samplesPerPixel == other.samplesPerPixel
+            && maxDepth == other.maxDepth && rouletteMinDepth == other.rouletteMinDepth && seed == other.seed
+            && pixelSize == other.pixelSize && sampler == other.sampler
+            && sampleLights == other.sampleLights && skyIntensity == other.skyIntensity && sceneHash == other.sceneHash;
+    }
+};
+
+// Header, sample counts then float sums of every pixel, in the byte order of the machine
+// Written to a temporary file renamed over the old checkpoint, so a render killed while saving keeps the previous one
+bool SaveCheckpoint(const std::string& path, const Framebuffer& framebuffer, const CheckpointHeader& header) {
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        if (!file) {
+            std::cerr << "Can't write checkpoint " << temporaryPath << ".\n";
+            return false;
+        }
+
+        size_t pixelCount = static_cast<size_t>(framebuffer.Width()) * framebuffer.Height();
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(framebuffer.SampleCounts()), pixelCount * sizeof(int));
+        file.write(reinterpret_cast<const char*>(framebuffer.Pixels()), pixelCount * sizeof(Vec3));
+        if (!file) {
+            std::cerr << "Can't write checkpoint " << temporaryPath << ".\n";
+            return false;
+        }
+    }
+
+    std::remove(path.c_str());
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+// Fills framebuffer and header from the checkpoint, false when there is none or it doesn't belong to this render
+bool LoadCheckpoint(const std::string& path, Framebuffer& framebuffer, const CheckpointHeader& expected, CheckpointHeader& header) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file || !file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+
+    if (!header.SameRender(expected)) {
+        std::cerr << "Checkpoint " << path << " was made with another scene or other render settings, ignored.\n";
+        return false;
+    }
+
+    size_t pixelCount = static_cast<size_t>(framebuffer.Width()) * framebuffer.Height();
+    file.read(reinterpret_cast<char*>(framebuffer.SampleCounts()), pixelCount * sizeof(int));
+    file.read(reinterpret_cast<char*>(framebuffer.Pixels()), pixelCount * sizeof(Vec3));
+    if (!file) {
+        std::cerr << "Checkpoint " << path << " is truncated, ignored.\n";
+        framebuffer.Clear();
+        return false;
+    }
+
+    return true;
+}
+
+// Renders samplesPerPixel in passes of passSamples, resuming from the checkpoint when there is one
+// The image is the same as a single Render(), whatever the passes and the interruptions
+// counters, when given, gets the path counters of all the passes rendered by this call
+std::vector<TileStats> RenderProgressive(TileRenderer& renderer, const Hittable& world, const Camera& cam, Framebuffer& framebuffer, const ProgressiveSettings& progressive,
+                                         PathCounters* counters = nullptr) {
+    const RenderSettings& settings = renderer.Settings();
+    if (settings.adaptive) {
+        std::cerr << "Adaptive sampling can't be split in passes, rendering in one pass.\n";
+        std::vector<TileStats> stats = renderer.Render(world, cam, framebuffer);
+        if (counters) {
+            counters->Merge(renderer.LastPathCounters());
+        }
+        return stats;
+    }
+
+    framebuffer.Clear();
+    int nextSample = 0;
+
+    CheckpointHeader expected = CheckpointHeader::For(settings, 0, progressive.sceneHash);
+    CheckpointHeader loaded;
+    if (!progressive.checkpointPath.empty() && LoadCheckpoint(progressive.checkpointPath, framebuffer, expected, loaded)) {
+        nextSample = loaded.nextSample;
+        std::cerr << "Resuming from " << progressive.checkpointPath << " at " << nextSample << " samples per pixel\n";
+    }
+
+    std::vector<TileStats> stats;
+    int passSamples = std::max(1, progressive.passSamples);
+    for (int pass = 0; nextSample < settings.samplesPerPixel; pass++) {
+        int count = std::min(passSamples, settings.samplesPerPixel - nextSample);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<TileStats> passStats = renderer.RenderPass(world, cam, framebuffer, nextSample, count);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        nextSample += count;
+        if (counters) {
+            counters->Merge(renderer.LastPathCounters());
+        }
+
+        // Time per tile over all the passes
+        if (stats.empty()) {
+            stats = passStats;
+        }
+        else {
+            for (size_t i = 0; i < stats.size(); i++) {
+                stats[i].milliseconds += passStats[i].milliseconds;
+            }
+        }
+
+        std::cerr << "\rPass " << pass + 1 << ": " << nextSample << "/" << settings.samplesPerPixel << " samples per pixel, " << seconds << " s\n";
+
+        bool done = nextSample >= settings.samplesPerPixel;
+        if (!progressive.previewPath.empty() && (done || (pass + 1) % std::max(1, progressive.previewEvery) == 0)) {
+            WriteImage(progressive.previewPath, framebuffer);
+        }
+        if (!progressive.checkpointPath.empty() && !done && (pass + 1) % std::max(1, progressive.checkpointEvery) == 0) {
+            SaveCheckpoint(progressive.checkpointPath, framebuffer, CheckpointHeader::For(settings, nextSample, progressive.sceneHash));
+        }
+    }
+
+    if (!progressive.checkpointPath.empty()) {
+        std::remove(progressive.checkpointPath.c_str());
+    }
+
+    return stats;
+}
+
+#endif //PROGRESSIVE_H
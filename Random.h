@@ -0,0 +1,118 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Small, fast generators used instead of rand() (which locks a global state and can't be reproduced across threads)
+// They all expose the same interface so RandomEngine can be switched at compile time
+
+inline uint64_t SplitMix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// PCG-XSH-RR, 64 bits of state, 32 bits output (O'Neill)
+class Pcg32 {
+    private:
+        uint64_t mState = 0x853C49E6748FEA9Bull;
+        uint64_t mIncrement = 0xDA3E39CB94B95BDBull;
+
+    public:
+        Pcg32() {}
+        Pcg32(uint64_t seed, uint64_t stream = 0) { Seed(seed, stream); }
+
+        // Different streams give independent sequences for the same seed
+        void Seed(uint64_t seed, uint64_t stream = 0) {
+            mState = 0;
+            mIncrement = (stream << 1) | 1u;
+            NextUInt();
+            mState += seed;
+            NextUInt();
+        }
+
+        uint32_t NextUInt() {
+            uint64_t old = mState;
+            mState = old * 6364136223846793005ull + mIncrement;
+            uint32_t xorShifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+            uint32_t rotation = static_cast<uint32_t>(old >> 59);
+            return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+        }
+
+        // Returns a random real in [0, 1[
+        double NextDouble() {
+            return NextUInt() * (1.0 / 4294967296.0);
+        }
+};
+
+// xoshiro256+ (Blackman, Vigna), the upper bits are good enough to build doubles
+class Xoshiro256Plus {
+    private:
+        uint64_t mS[4] = { 1, 2, 3, 4 };
+
+        static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    public:
+        Xoshiro256Plus() {}
+        Xoshiro256Plus(uint64_t seed, uint64_t stream = 0) { Seed(seed, stream); }
+
+        void Seed(uint64_t seed, uint64_t stream = 0) {
+            uint64_t state = seed ^ (stream * 0xD1342543DE82EF95ull);
+            for (uint64_t& s : mS) {
+                s = SplitMix64(state);
+            }
+        }
+
+        uint64_t NextULong() {
+            uint64_t result = mS[0] + mS[3];
+            uint64_t t = mS[1] << 17;
+
+            mS[2] ^= mS[0];
+            mS[3] ^= mS[1];
+            mS[1] ^= mS[2];
+            mS[0] ^= mS[3];
+            mS[2] ^= t;
+            mS[3] = Rotl(mS[3], 45);
+
+            return result;
+        }
+
+        uint32_t NextUInt() {
+            return static_cast<uint32_t>(NextULong() >> 32);
+        }
+
+        // Returns a random real in [0, 1[
+        double NextDouble() {
+            return (NextULong() >> 11) * (1.0 / 9007199254740992.0);
+        }
+};
+
+#ifdef RAYTRACER_RNG_XOSHIRO
+using RandomEngine = Xoshiro256Plus;
+#else
+using RandomEngine = Pcg32;
+#endif
+
+// Every thread owns its engine, so worker threads never share (or lock) a random state
+inline RandomEngine& RandomGenerator() {
+    thread_local RandomEngine engine;
+    return engine;
+}
+
+inline void SeedRandom(uint64_t seed, uint64_t stream = 0) {
+    RandomGenerator().Seed(seed, stream);
+}
+
+// Mixes a base seed with pixel coordinates so each pixel gets its own reproducible random stream
+inline uint64_t PixelSeed(uint64_t seed, int x, int y) {
+    uint64_t state = seed ^ (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) ^ static_cast<uint32_t>(y);
+    return SplitMix64(state);
+}
+
+// Seeds the calling thread for one sample of one pixel, the sample can then be replayed on its own
+inline void SeedSample(uint64_t seed, int x, int y, int sample) {
+    SeedRandom(PixelSeed(seed, x, y), static_cast<uint64_t>(sample));
+}
+
+#endif //RANDOM_H
@@ -3,18 +3,24 @@
 
 #include "Vec3.h"
 
-class Ray
+template <typename T>
+class RayT
 {
     public:
-        Vec3 mOrigin;
-        Vec3 mDirection;
+        Vec3T<T> mOrigin;
+        Vec3T<T> mDirection;
+        // When the ray is cast within the shutter interval of the frame, 0 (open) to 1 (closed), for motion blur
+        T mTime = 0;
 
     public:
-        Ray() {}
-        Ray(const Vec3& origin, const Vec3& direction) { mOrigin = origin; mDirection = direction; }
-        Vec3 origin() const { return mOrigin; }
-        Vec3 direction() const { return mDirection; }
-        Vec3 point_at_parameter(float t) const { return mOrigin + t*mDirection; }
+        RayT() {}
+        RayT(const Vec3T<T>& origin, const Vec3T<T>& direction, T time = 0) { mOrigin = origin; mDirection = direction; mTime = time; }
+        Vec3T<T> origin() const { return mOrigin; }
+        Vec3T<T> direction() const { return mDirection; }
+        T time() const { return mTime; }
+        Vec3T<T> point_at_parameter(T t) const { return mOrigin + t*mDirection; }
 };
 
-#endif
\ No newline at end of file
+typedef RayT<Real> Ray;
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "Ray.h"
+
+// Rays traced together through the scene, typically the primary rays of a 4x4 pixel block
+struct RayPacket {
+    static const int maxSize = 16;
+
+    Ray rays[maxSize];
+    int count = 0;
+
+    void Clear() { count = 0; }
+    void Add(const Ray& r) { rays[count++] = r; }
+};
+
+#endif //RAY_PACKET_H
@@ -0,0 +1,679 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Utility.h"
+#include "Camera.h"
+#include "Framebuffer.h"
+#include "Hittable.h"
+#include "Integrator.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+#include "Wavefront.h"
+
+enum class IntegratorMode { Iterative, Wavefront };
+
+struct RenderSettings {
+    int imageWidth = 400;
+    int imageHeight = 266;
+    int samplesPerPixel = 500;
+    int maxDepth = 50;
+    // Bounces before russian roulette may end a path, negative to always trace maxDepth bounces
+    int rouletteMinDepth = 3;
+    // Side of the square tiles handed out to the threads, in pixels
+    int tileSize = 16;
+    // 0 -> one thread per hardware thread
+    int threadCount = 0;
+    // Every pixel derives its random stream from this seed, so the image doesn't depend on the thread count
+    uint64_t seed = 0;
+    // Trace the primary rays of 4x4 pixel blocks as packets, bounces are still traced one ray at a time
+    bool usePackets = true;
+    // Wavefront traces the paths of a tile in batches, stage by stage (packets are not used then)
+    IntegratorMode integrator = IntegratorMode::Iterative;
+    // Paths traced together by the wavefront integrator
+    int wavefrontSize = 4096;
+    // Adaptive sampling: samplesPerPixel becomes the average budget of a tile, spent where the pixels are the noisiest
+    // Pixels are traced one by one then (no packets, no wavefront)
+    bool adaptive = false;
+    // Samples every pixel gets before its variance is trusted
+    int adaptiveMinSamples = 16;
+    // A pixel stops once the 95% confidence interval of its luminance is below this fraction of its mean
+    double adaptiveThreshold = 0.02;
+    // No pixel gets more than this many times samplesPerPixel
+    int adaptiveMaxFactor = 4;
+    // Where the pixel position and lens numbers of each sample come from (Sampling.h), bounces always use the engine
+    SamplerKind sampler = SamplerKind::Sobol;
+    // Next event estimation: a shadow ray toward the lights given with SetLights() at every diffuse bounce
+    bool sampleLights = true;
+    // Scale of the sky gradient, 0 for scenes only lit by their emitters
+    double skyIntensity = 1.0;
+};
+
+struct Tile {
+    // Pixel bounds, x1 and y1 excluded
+    int x0, y0, x1, y1;
+};
+
+struct TileStats {
+    Tile tile;
+    double milliseconds;
+};
+
+// Running luminance statistics of one pixel (Welford)
+struct PixelEstimate {
+    Vec3 sum = Vec3(0, 0, 0);
+    int count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void Add(const Vec3& color) {
+        sum += color;
+        count++;
+
+        double luminance = 0.2126 * color.x() + 0.7152 * color.y() + 0.0722 * color.z();
+        double delta = luminance - mean;
+        mean += delta / count;
+        m2 += delta * (luminance - mean);
+    }
+
+    // Half width of the 95% confidence interval of the mean luminance, relative to the mean
+    double RelativeError() const {
+        if (count < 2) {
+            return infinity;
+        }
+        double variance = m2 / (count - 1);
+        return 1.96 * sqrt(variance / count) / std::max(mean, 0.05);
+    }
+};
+
+struct AdaptiveStats {
+    uint64_t pixels = 0;
+    uint64_t samples = 0;
+    uint64_t convergedPixels = 0;
+    // Samples the fixed budget would have used
+    uint64_t budget = 0;
+
+    void Merge(const AdaptiveStats& other) {
+        pixels += other.pixels;
+        samples += other.samples;
+        convergedPixels += other.convergedPixels;
+        budget += other.budget;
+    }
+};
+
+class TileRenderer {
+    private:
+        RenderSettings mSettings;
+        // Stage statistics of the last wavefront render
+        WavefrontStats mWavefrontStats;
+        // Path statistics of the last render
+        PathCounters mPathCounters;
+        AdaptiveStats mAdaptiveStats;
+        std::function<void(int, int)> mRowsCompleted;
+        bool mShowProgress = true;
+        // Emitters of the world being rendered, owned by the caller
+        const LightList* mLights = nullptr;
+        // Samples [mFirstSample, mFirstSample + mPassSamples[ of every pixel make the pass being rendered
+        int mFirstSample = 0;
+        int mPassSamples = 0;
+        // Started by the first render and kept for the next ones
+        std::unique_ptr<ThreadPool> mPool;
+
+    public:
+        TileRenderer(const RenderSettings& settings) : mSettings(settings), mPassSamples(settings.samplesPerPixel) {}
+
+        const RenderSettings& Settings() const { return mSettings; }
+
+        // Settings of the next renders, the threads are kept unless their number changes
+        void SetSettings(const RenderSettings& settings) {
+            mSettings = settings;
+            mPassSamples = settings.samplesPerPixel;
+        }
+
+        PathSettings Paths() const {
+            PathSettings paths;
+            paths.maxDepth = mSettings.maxDepth;
+            paths.rouletteMinDepth = mSettings.rouletteMinDepth;
+            paths.lights = mSettings.sampleLights ? mLights : nullptr;
+            paths.skyIntensity = static_cast<Real>(mSettings.skyIntensity);
+            return paths;
+        }
+
+        // Lights of the world given to the next renders, they must outlive them (null for none)
+        void SetLights(const LightList* lights) { mLights = lights; }
+        const LightList* Lights() const { return mLights; }
+
+        int ThreadCount() const {
+            if (mSettings.threadCount > 0) {
+                return mSettings.threadCount;
+            }
+
+            int hardwareThreads = static_cast<int>(std::thread::hardware_concurrency());
+            return hardwareThreads > 0 ? hardwareThreads : 1;
+        }
+
+        std::vector<Tile> MakeTiles() const {
+            std::vector<Tile> tiles;
+            int size = std::max(1, mSettings.tileSize);
+
+            for (int y = 0; y < mSettings.imageHeight; y += size) {
+                for (int x = 0; x < mSettings.imageWidth; x += size) {
+                    tiles.push_back({ x, y, std::min(x + size, mSettings.imageWidth), std::min(y + size, mSettings.imageHeight) });
+                }
+            }
+
+            return tiles;
+        }
+
+        // Pixel position, lens then time, from the sampler: the Random sampler consumes five numbers of the engine
+        Ray PrimaryRay(const Camera& cam, int x, int y, int sample) const {
+            double numbers[primarySampleDimensions];
+            PrimarySample(mSettings.sampler, mSettings.seed, x, y, sample, numbers);
+
+            // The framebuffer is stored top row first, the camera expects v to grow upwards
+            int row = mSettings.imageHeight - 1 - y;
+
+            double u = (x + numbers[0]) / (mSettings.imageWidth - 1);
+            double v = (row + numbers[1]) / (mSettings.imageHeight - 1);
+            return cam.GetRay(u, v, numbers[2], numbers[3], numbers[4]);
+        }
+
+        // Adds the samples of the pass to color, one at a time so splitting the samples in passes doesn't change the sum
+        Vec3 RenderPixel(const Hittable& world, const Camera& cam, int x, int y, PathCounters& counters, Vec3 color = Vec3(0, 0, 0)) const {
+            PathSettings paths = Paths();
+
+            for (int s = mFirstSample; s < mFirstSample + mPassSamples; s++) {
+                // Reseeding per sample makes the result independent of which thread renders the pixel
+                SeedSample(mSettings.seed, x, y, s);
+
+                Ray r = PrimaryRay(cam, x, y, s);
+                color += TracePath(r, world, paths, counters);
+            }
+
+            return color;
+        }
+
+        // Same result as RenderPixel() on every pixel of the tile, the primary rays of each 4x4 block being traced together
+        void RenderTilePackets(const Hittable& world, const Camera& cam, const Tile& tile, Framebuffer& framebuffer, PathCounters& counters) const {
+            const int blockSize = 4;
+            PathSettings paths = Paths();
+
+            for (int blockY = tile.y0; blockY < tile.y1; blockY += blockSize) {
+                for (int blockX = tile.x0; blockX < tile.x1; blockX += blockSize) {
+                    int pixelX[RayPacket::maxSize];
+                    int pixelY[RayPacket::maxSize];
+                    Vec3 colors[RayPacket::maxSize];
+                    int count = 0;
+
+                    for (int y = blockY; y < std::min(blockY + blockSize, tile.y1); ++y) {
+                        for (int x = blockX; x < std::min(blockX + blockSize, tile.x1); ++x) {
+                            pixelX[count] = x;
+                            pixelY[count] = y;
+                            colors[count] = framebuffer.At(x, y);
+                            count++;
+                        }
+                    }
+
+                    RayPacket packet;
+                    HitRecord recs[RayPacket::maxSize];
+                    bool hits[RayPacket::maxSize];
+                    // Random state of every ray once its primary ray is built, the rest of its path continues from there
+                    RandomEngine engines[RayPacket::maxSize];
+
+                    for (int s = mFirstSample; s < mFirstSample + mPassSamples; s++) {
+                        packet.Clear();
+                        for (int i = 0; i < count; i++) {
+                            SeedSample(mSettings.seed, pixelX[i], pixelY[i], s);
+                            packet.Add(PrimaryRay(cam, pixelX[i], pixelY[i], s));
+                            engines[i] = RandomGenerator();
+                        }
+
+                        // No segment to trace, TracePath() still counts the paths (black)
+                        if (mSettings.maxDepth <= 0) {
+                            for (int i = 0; i < count; i++) {
+                                colors[i] += TracePath(packet.rays[i], world, paths, counters);
+                            }
+                            continue;
+                        }
+
+                        world.HitPacket(packet, 0.001, infinity, recs, hits);
+
+                        for (int i = 0; i < count; i++) {
+                            RandomGenerator() = engines[i];
+                            if (hits[i]) {
+                                colors[i] += TracePath(packet.rays[i], world, paths, counters, &recs[i]);
+                            }
+                            else {
+                                // The path TracePath() would end at its first segment
+                                counters.paths++;
+                                PROFILE_PATH();
+                                counters.segments++;
+                                colors[i] += paths.skyIntensity * SkyColor(packet.rays[i]);
+                            }
+                        }
+                    }
+
+                    for (int i = 0; i < count; i++) {
+                        framebuffer.At(pixelX[i], pixelY[i]) = colors[i];
+                    }
+                }
+            }
+        }
+
+        // Same result as RenderPixel() on every pixel of the tile, paths of consecutive (pixel, sample) pairs being traced as one wavefront
+        void RenderTileWavefront(WavefrontIntegrator& integrator, const Camera& cam, const Tile& tile, Framebuffer& framebuffer, WavefrontStats& stats, PathCounters& counters) const {
+            int tileWidth = tile.x1 - tile.x0;
+            int pixelCount = tileWidth * (tile.y1 - tile.y0);
+            long long pathCount = static_cast<long long>(pixelCount) * mPassSamples;
+            size_t batchSize = static_cast<size_t>(std::max(1, mSettings.wavefrontSize));
+
+            if (mSettings.maxDepth <= 0) {
+                return;
+            }
+
+            std::vector<PathState> paths;
+            paths.reserve(batchSize);
+
+            for (long long first = 0; first < pathCount; first += batchSize) {
+                long long last = std::min(pathCount, first + static_cast<long long>(batchSize));
+
+                auto start = std::chrono::steady_clock::now();
+                paths.clear();
+                for (long long p = first; p < last; p++) {
+                    int pixel = static_cast<int>(p / mPassSamples);
+                    int s = mFirstSample + static_cast<int>(p % mPassSamples);
+                    int x = tile.x0 + pixel % tileWidth;
+                    int y = tile.y0 + pixel / tileWidth;
+
+                    SeedSample(mSettings.seed, x, y, s);
+                    PathState path;
+                    path.ray = PrimaryRay(cam, x, y, s);
+                    path.throughput = Vec3(1.0, 1.0, 1.0);
+                    path.color = Vec3(0, 0, 0);
+                    path.bsdfPdf = 0;
+                    path.engine = RandomGenerator();
+                    path.depth = mSettings.maxDepth;
+                    paths.push_back(path);
+                }
+                WavefrontStageStats& generate = stats.stages[WavefrontStats::Generate];
+                generate.rays += paths.size();
+                generate.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                integrator.Trace(paths, stats, counters);
+
+                // Paths come back in order, so every pixel adds its samples in the same order as RenderPixel()
+                for (long long p = first; p < last; p++) {
+                    int pixel = static_cast<int>(p / mPassSamples);
+                    framebuffer.At(tile.x0 + pixel % tileWidth, tile.y0 + pixel / tileWidth) += paths[p - first].color;
+                }
+            }
+        }
+
+        const WavefrontStats& LastWavefrontStats() const { return mWavefrontStats; }
+        const PathCounters& LastPathCounters() const { return mPathCounters; }
+        const AdaptiveStats& LastAdaptiveStats() const { return mAdaptiveStats; }
+
+        // callback(y0, y1) runs once the rows [y0, y1[ of the framebuffer are final, rows come top to bottom and in order
+        // It is called from the render threads, one call at a time, so it can stream the image while the rest renders
+        void OnRowsCompleted(std::function<void(int, int)> callback) { mRowsCompleted = callback; }
+
+        // Tiles remaining on stderr while rendering
+        void ShowProgress(bool show) { mShowProgress = show; }
+
+        int MaxAdaptiveSamples() const { return std::max(1, mSettings.adaptiveMaxFactor) * mSettings.samplesPerPixel; }
+
+        // Every pixel first gets adaptiveMinSamples, then the rest of the tile budget goes in rounds to the pixels
+        // that haven't converged, noisiest first. Only depends on the tile, so the result doesn't depend on the threads
+        void RenderTileAdaptive(const Hittable& world, const Camera& cam, const Tile& tile, Framebuffer& framebuffer, PathCounters& counters, AdaptiveStats& stats) const {
+            PathSettings paths = Paths();
+            int tileWidth = tile.x1 - tile.x0;
+            int pixelCount = tileWidth * (tile.y1 - tile.y0);
+            int minSamples = std::max(2, std::min(mSettings.adaptiveMinSamples, mSettings.samplesPerPixel));
+            int maxSamples = MaxAdaptiveSamples();
+
+            long long budget = static_cast<long long>(mSettings.samplesPerPixel) * pixelCount;
+            std::vector<PixelEstimate> estimates(pixelCount);
+
+            auto sample = [&](int pixel, int count) {
+                int x = tile.x0 + pixel % tileWidth;
+                int y = tile.y0 + pixel / tileWidth;
+                PixelEstimate& estimate = estimates[pixel];
+                for (int i = 0; i < count; i++) {
+                    SeedSample(mSettings.seed, x, y, estimate.count);
+                    estimate.Add(TracePath(PrimaryRay(cam, x, y, estimate.count), world, paths, counters));
+                }
+                budget -= count;
+            };
+
+            for (int pixel = 0; pixel < pixelCount; pixel++) {
+                sample(pixel, minSamples);
+            }
+
+            std::vector<int> pending;
+            while (budget > 0) {
+                pending.clear();
+                for (int pixel = 0; pixel < pixelCount; pixel++) {
+                    const PixelEstimate& estimate = estimates[pixel];
+                    if (estimate.count < maxSamples && estimate.RelativeError() > mSettings.adaptiveThreshold) {
+                        pending.push_back(pixel);
+                    }
+                }
+                if (pending.empty()) {
+                    break;
+                }
+
+                std::stable_sort(pending.begin(), pending.end(), [&](int a, int b) { return estimates[a].RelativeError() > estimates[b].RelativeError(); });
+
+                // Spread what is left over the pending pixels, a round gives at most minSamples to each
+                long long share = std::max(1LL, std::min<long long>(minSamples, budget / static_cast<long long>(pending.size())));
+                for (int pixel : pending) {
+                    if (budget <= 0) {
+                        break;
+                    }
+                    int count = static_cast<int>(std::min<long long>(share, std::min<long long>(budget, maxSamples - estimates[pixel].count)));
+                    sample(pixel, count);
+                }
+            }
+
+            for (int pixel = 0; pixel < pixelCount; pixel++) {
+                const PixelEstimate& estimate = estimates[pixel];
+                int x = tile.x0 + pixel % tileWidth;
+                int y = tile.y0 + pixel / tileWidth;
+                framebuffer.At(x, y) = estimate.sum;
+                framebuffer.SetSampleCount(x, y, estimate.count);
+
+                stats.samples += estimate.count;
+                if (estimate.RelativeError() <= mSettings.adaptiveThreshold) {
+                    stats.convergedPixels++;
+                }
+            }
+            stats.pixels += pixelCount;
+            stats.budget += static_cast<uint64_t>(mSettings.samplesPerPixel) * pixelCount;
+        }
+
+        // Primary hits per second on one thread, over one sample of every pixel, with or without packets
+        double PrimaryRayRate(const Hittable& world, const Camera& cam, bool usePackets) const {
+            const int blockSize = 4;
+            RayPacket packet;
+            HitRecord recs[RayPacket::maxSize];
+            bool hits[RayPacket::maxSize];
+            long long rayCount = 0;
+
+            auto start = std::chrono::steady_clock::now();
+
+            for (int blockY = 0; blockY < mSettings.imageHeight; blockY += blockSize) {
+                for (int blockX = 0; blockX < mSettings.imageWidth; blockX += blockSize) {
+                    packet.Clear();
+                    for (int y = blockY; y < std::min(blockY + blockSize, mSettings.imageHeight); ++y) {
+                        for (int x = blockX; x < std::min(blockX + blockSize, mSettings.imageWidth); ++x) {
+                            SeedSample(mSettings.seed, x, y, 0);
+                            packet.Add(PrimaryRay(cam, x, y, 0));
+                        }
+                    }
+
+                    if (usePackets) {
+                        world.HitPacket(packet, 0.001, infinity, recs, hits);
+                    }
+                    else {
+                        for (int i = 0; i < packet.count; i++) {
+                            hits[i] = world.Hit(packet.rays[i], 0.001, infinity, recs[i]);
+                        }
+                    }
+                    rayCount += packet.count;
+                }
+            }
+
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return seconds > 0.0 ? rayCount / seconds : 0.0;
+        }
+
+        // Renders the whole image into framebuffer and returns the time spent on every tile
+        std::vector<TileStats> Render(const Hittable& world, const Camera& cam, Framebuffer& framebuffer) {
+            framebuffer.Clear();
+            return RenderPass(world, cam, framebuffer, 0, mSettings.samplesPerPixel);
+        }
+
+        // Adds the samples [firstSample, firstSample + sampleCount[ of every pixel to framebuffer, passes can be split
+        // any way and give the same image as Render(). Adaptive sampling needs the whole budget in one pass
+        std::vector<TileStats> RenderPass(const Hittable& world, const Camera& cam, Framebuffer& framebuffer, int firstSample, int sampleCount) {
+            return RenderTiles(world, cam, framebuffer, MakeTiles(), firstSample, sampleCount);
+        }
+
+        // RenderPass() over some of the tiles of MakeTiles() only, for workers sharing a frame (Distributed.h)
+        // The sample counts of the whole framebuffer are reset, rows are only reported complete once all their tiles are
+        std::vector<TileStats> RenderTiles(const Hittable& world, const Camera& cam, Framebuffer& framebuffer, const std::vector<Tile>& tiles, int firstSample, int sampleCount) {
+            std::vector<TileStats> stats(tiles.size());
+            mWavefrontStats = WavefrontStats();
+            mPathCounters = PathCounters();
+            mAdaptiveStats = AdaptiveStats();
+            mFirstSample = firstSample;
+            mPassSamples = sampleCount;
+            framebuffer.ResetSampleCounts(firstSample + sampleCount);
+
+            // Threads grab the next tile from a shared counter, fast threads simply end up rendering more tiles
+            std::atomic<size_t> nextTile(0);
+            std::atomic<size_t> tilesDone(0);
+            std::mutex progressMutex;
+
+            // Tiles left in every row of tiles, a row is handed to mRowsCompleted once it and all the rows above are done
+            int tileSize = std::max(1, mSettings.tileSize);
+            int tilesPerRow = (mSettings.imageWidth + tileSize - 1) / tileSize;
+            std::vector<int> tilesLeft((mSettings.imageHeight + tileSize - 1) / tileSize, tilesPerRow);
+            size_t nextRow = 0;
+
+            auto worker = [&]() {
+                // Every thread has its own integrator queues and statistics, merged once it is done
+                WavefrontIntegrator integrator(world, Paths());
+                WavefrontStats wavefrontStats;
+                PathCounters pathCounters;
+                AdaptiveStats adaptiveStats;
+
+                while (true) {
+                    size_t index = nextTile.fetch_add(1);
+                    if (index >= tiles.size()) {
+                        std::lock_guard<std::mutex> lock(progressMutex);
+                        mWavefrontStats.Merge(wavefrontStats);
+                        mPathCounters.Merge(pathCounters);
+                        mAdaptiveStats.Merge(adaptiveStats);
+                        return;
+                    }
+
+                    const Tile& tile = tiles[index];
+                    auto start = std::chrono::steady_clock::now();
+
+                    if (mSettings.adaptive) {
+                        RenderTileAdaptive(world, cam, tile, framebuffer, pathCounters, adaptiveStats);
+                    }
+                    else if (mSettings.integrator == IntegratorMode::Wavefront) {
+                        RenderTileWavefront(integrator, cam, tile, framebuffer, wavefrontStats, pathCounters);
+                    }
+                    else if (mSettings.usePackets) {
+                        RenderTilePackets(world, cam, tile, framebuffer, pathCounters);
+                    }
+                    else {
+                        for (int y = tile.y0; y < tile.y1; ++y) {
+                            for (int x = tile.x0; x < tile.x1; ++x) {
+                                framebuffer.At(x, y) = RenderPixel(world, cam, x, y, pathCounters, framebuffer.At(x, y));
+                            }
+                        }
+                    }
+
+                    auto end = std::chrono::steady_clock::now();
+                    stats[index] = { tile, std::chrono::duration<double, std::milli>(end - start).count() };
+
+                    size_t done = ++tilesDone;
+                    std::lock_guard<std::mutex> lock(progressMutex);
+                    // Progress bar
+                    if (mShowProgress) {
+                        std::cerr << "\rTiles remaining: " << tiles.size() - done << " " << std::flush;
+                    }
+
+                    tilesLeft[tile.y0 / tileSize]--;
+                    while (nextRow < tilesLeft.size() && tilesLeft[nextRow] == 0) {
+                        if (mRowsCompleted) {
+                            mRowsCompleted(static_cast<int>(nextRow) * tileSize, std::min(static_cast<int>(nextRow + 1) * tileSize, mSettings.imageHeight));
+                        }
+                        nextRow++;
+                    }
+                }
+            };
+
+            // The calling thread works too
+            Pool().Run(worker);
+
+            return stats;
+        }
+
+        // Threads of the renders, started on first use and restarted when the thread count changes
+        ThreadPool& Pool() {
+            if (!mPool || mPool->ThreadCount() != ThreadCount()) {
+                mPool.reset(new ThreadPool(ThreadCount()));
+            }
+            return *mPool;
+        }
+
+        // Albedo, normal and depth of every pixel, averaged over the primary rays of the first samples (same pixel and
+        // lens positions as the color samples). Mirrors and glass are followed to the first diffuse surface, whose
+        // features are the ones the reflection or refraction shows (albedo tinted by the bounces, depth along the path)
+        // Primary rays and a few specular bounces only: a small fraction of a render
+        void RenderAovs(const Hittable& world, const Camera& cam, AovBuffers& aovs, int sampleCount = 8, int maxSpecularBounces = 4) {
+            std::atomic<int> nextRow(0);
+
+            auto worker = [&]() {
+                for (int y = nextRow++; y < mSettings.imageHeight; y = nextRow++) {
+                    for (int x = 0; x < mSettings.imageWidth; x++) {
+                        Vec3 albedo(0, 0, 0);
+                        Vec3 normal(0, 0, 0);
+                        double depth = 0.0;
+                        for (int s = 0; s < sampleCount; s++) {
+                            SeedSample(mSettings.seed, x, y, s);
+                            Ray r = PrimaryRay(cam, x, y, s);
+                            Vec3 tint(1, 1, 1);
+                            double distance = 0.0;
+                            for (int bounce = 0; ; bounce++) {
+                                HitRecord rec;
+                                if (!world.Hit(r, 0.001, infinity, rec)) {
+                                    albedo += tint * SkyColor(r);
+                                    break;
+                                }
+                                distance += rec.t * r.direction().length();
+
+                                MaterialKind kind = rec.materialPtr->mKind;
+                                Vec3 attenuation;
+                                Ray scattered;
+                                bool specular = kind == MaterialKind::Metal || kind == MaterialKind::Dielectric;
+                                if (!specular || bounce >= maxSpecularBounces || !ScatterMaterial(rec.materialPtr, r, rec, attenuation, scattered)) {
+                                    albedo += tint * rec.materialPtr->Albedo();
+                                    normal += rec.normal;
+                                    depth += distance;
+                                    break;
+                                }
+                                tint *= attenuation;
+                                r = scattered;
+                            }
+                        }
+                        aovs.Albedo(x, y) = albedo / Real(sampleCount);
+                        aovs.Normal(x, y) = normal / Real(sampleCount);
+                        aovs.Depth(x, y) = static_cast<float>(depth / sampleCount);
+                    }
+                }
+            };
+
+            Pool().Run(worker);
+        }
+};
+
+// Prints how render time is spread over the tiles, a high max/mean ratio means some tiles (geometry heavy ones) dominate
+void PrintTileReport(std::ostream& out, const std::vector<TileStats>& stats, int slowestCount = 5) {
+    if (stats.empty()) {
+        return;
+    }
+
+    double total = 0.0;
+    double fastest = stats[0].milliseconds;
+    double slowest = stats[0].milliseconds;
+    for (const TileStats& s : stats) {
+        total += s.milliseconds;
+        fastest = std::min(fastest, s.milliseconds);
+        slowest = std::max(slowest, s.milliseconds);
+    }
+    double mean = total / stats.size();
+
+    out << "Tiles: " << stats.size()
+        << " | min " << fastest << " ms | mean " << mean << " ms | max " << slowest << " ms"
+        << " | max/mean " << (mean > 0.0 ? slowest / mean : 0.0) << '\n';
+
+    std::vector<TileStats> sorted = stats;
+    std::sort(sorted.begin(), sorted.end(), [](const TileStats& a, const TileStats& b) { return a.milliseconds > b.milliseconds; });
+
+    for (int i = 0; i < slowestCount && i < static_cast<int>(sorted.size()); i++) {
+        const Tile& t = sorted[i].tile;
+        out << "  slow tile [" << t.x0 << ", " << t.y0 << "] -> [" << t.x1 << ", " << t.y1 << "[ : " << sorted[i].milliseconds << " ms\n";
+    }
+}
+
+void PrintAdaptiveReport(std::ostream& out, const AdaptiveStats& stats) {
+    if (stats.pixels == 0) {
+        return;
+    }
+
+    out << "Adaptive sampling: " << double(stats.samples) / stats.pixels << " samples per pixel on average ("
+        << 100.0 * stats.samples / stats.budget << "% of the budget), "
+        << 100.0 * stats.convergedPixels / stats.pixels << "% of the pixels converged\n";
+}
+
+// Black -> blue -> red -> white as t goes from 0 to 1, written as a P3 pixel
+void WriteHeatmapPixel(std::ostream& out, double t) {
+    t = Clamp(t, 0.0, 1.0);
+
+    double r = Clamp(3.0 * t - 1.0, 0.0, 1.0);
+    double g = Clamp(3.0 * t - 2.0, 0.0, 1.0);
+    double b = Clamp(t < 0.5 ? 3.0 * t : 2.0 - 2.0 * t, 0.0, 1.0);
+
+    out << static_cast<int>(255.999 * Clamp(r, 0.0, 0.999)) << ' '
+        << static_cast<int>(255.999 * Clamp(g, 0.0, 0.999)) << ' '
+        << static_cast<int>(255.999 * Clamp(b, 0.0, 0.999)) << '\n';
+}
+
+// Samples used by every pixel as a P3 image, from black (no sample) through blue and red to white (maxSamples)
+void WriteSampleHeatmap(std::ostream& out, const Framebuffer& framebuffer, int maxSamples) {
+    out << "P3\n" << framebuffer.Width() << " " << framebuffer.Height() << "\n255\n";
+
+    for (int y = 0; y < framebuffer.Height(); ++y) {
+        for (int x = 0; x < framebuffer.Width(); ++x) {
+            WriteHeatmapPixel(out, double(framebuffer.SampleCount(x, y)) / maxSamples);
+        }
+    }
+}
+
+// Every pixel colored by the time of its tile relative to the slowest tile, shows where render time goes
+void WriteTileCostImage(std::ostream& out, const std::vector<TileStats>& stats, int width, int height) {
+    std::vector<double> cost(static_cast<size_t>(width) * height, 0.0);
+    double maxMilliseconds = 0.0;
+    for (const TileStats& s : stats) {
+        maxMilliseconds = std::max(maxMilliseconds, s.milliseconds);
+        for (int y = s.tile.y0; y < s.tile.y1; ++y) {
+            for (int x = s.tile.x0; x < s.tile.x1; ++x) {
+                cost[static_cast<size_t>(y) * width + x] = s.milliseconds;
+            }
+        }
+    }
+
+    out << "P3\n" << width << " " << height << "\n255\n";
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            WriteHeatmapPixel(out, maxMilliseconds > 0.0 ? cost[static_cast<size_t>(y) * width + x] / maxMilliseconds : 0.0);
+        }
+    }
+}
+
+#endif //RENDERER_H
@@ -0,0 +1,210 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "Utility.h"
+#include "Vec3.h"
+
+// Sample warping: every mapping turns uniform numbers in [0, 1[ into a point of the target domain in closed form
+// No rejection loop, so every call costs the same and draws the same count of numbers, and the only branches are
+// selects the compiler turns into blends
+
+// Point on the unit sphere (z uniform in [-1, 1], azimuth uniform)
+inline Vec3 UniformSphere(Real u1, Real u2) {
+    Real z = 1 - 2 * u1;
+    Real r = std::sqrt(std::fmax(Real(0), 1 - z * z));
+    Real phi = Real(2 * pi) * u2;
+    return Vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Point inside the unit ball: a direction scaled by the cube root of the third number
+inline Vec3 UniformBall(Real u1, Real u2, Real u3) {
+    return std::cbrt(u3) * UniformSphere(u1, u2);
+}
+
+// Shirley-Chiu concentric mapping of the square to the unit disk (z = 0), keeps the strata of the square compact
+inline Vec3 ConcentricDisk(Real u1, Real u2) {
+    Real a = 2 * u1 - 1;
+    Real b = 2 * u2 - 1;
+    bool xWedge = a * a > b * b;
+    // Both are 0 only at the center, where r = 0 whatever the angle: dividing by 1 keeps the angle finite
+    Real r = xWedge ? a : b;
+    Real phi = xWedge ? Real(pi / 4) * (b / (a != 0 ? a : 1)) : Real(pi / 2) - Real(pi / 4) * (a / (b != 0 ? b : 1));
+    return Vec3(r * std::cos(phi), r * std::sin(phi), 0);
+}
+
+// Cosine weighted direction around +z (Malley: the disk lifted to the hemisphere), already of unit length
+inline Vec3 CosineHemisphere(Real u1, Real u2) {
+    Vec3 d = ConcentricDisk(u1, u2);
+    Real z = std::sqrt(std::fmax(Real(0), 1 - d.x() * d.x() - d.y() * d.y()));
+    return Vec3(d.x(), d.y(), z);
+}
+
+// Tangent frame of a unit normal without a branch on the normal's direction (Duff et al. 2017)
+inline void OrthonormalBasis(const Vec3& n, Vec3& tangent, Vec3& bitangent) {
+    Real sign = std::copysign(Real(1), n.z());
+    Real a = -1 / (sign + n.z());
+    Real b = n.x() * n.y() * a;
+    tangent = Vec3(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+    bitangent = Vec3(b, sign + n.y() * n.y() * a, -n.y());
+}
+
+// Cosine weighted direction around a unit normal, of unit length
+inline Vec3 CosineHemisphere(const Vec3& normal, Real u1, Real u2) {
+    Vec3 local = CosineHemisphere(u1, u2);
+    Vec3 tangent, bitangent;
+    OrthonormalBasis(normal, tangent, bitangent);
+    return local.x() * tangent + local.y() * bitangent + local.z() * normal;
+}
+
+// Batch variants, structure of arrays: n samples per call in plain loops the compiler vectorizes
+// libm's sin and cos don't vectorize, so the disk angle is taken from the axis of its wedge, within [-pi/4, pi/4]
+// where short Taylor polynomials are as exact as float (errors below 5e-7 against ConcentricDisk())
+// The wedge is picked by multiplying with 0 or 1 rather than by selects: with trapping math (the default) the compiler
+// keeps the selects of float products as branches and gives up on the loop
+void ConcentricDiskBatch(const float* u1, const float* u2, float* x, float* y, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        float a = 2.0f * u1[i] - 1.0f;
+        float b = 2.0f * u2[i] - 1.0f;
+        float xWedge = float(a * a > b * b);
+        float yWedge = 1.0f - xWedge;
+        float r = xWedge * a + yWedge * b;
+        // The other wedge is at pi/2 - t, so its cos and sin swap. Both are 0 only at the center, divided by 1 there
+        float across = xWedge * b + yWedge * a;
+        float t = float(pi / 4) * (across / (r + float(r == 0.0f)));
+        float t2 = t * t;
+        float sinT = t * (1.0f + t2 * (-1.0f / 6.0f + t2 * (1.0f / 120.0f + t2 * (-1.0f / 5040.0f))));
+        float cosT = 1.0f + t2 * (-0.5f + t2 * (1.0f / 24.0f + t2 * (-1.0f / 720.0f + t2 * (1.0f / 40320.0f))));
+        x[i] = r * (xWedge * cosT + yWedge * sinT);
+        y[i] = r * (xWedge * sinT + yWedge * cosT);
+    }
+}
+
+// Around +z, rotate with OrthonormalBasis() for any other normal
+// Only the disk is vectorized, the square roots of the second loop stay scalar as each one may have to set errno
+void CosineHemisphereBatch(const float* u1, const float* u2, float* x, float* y, float* z, size_t n) {
+    ConcentricDiskBatch(u1, u2, x, y, n);
+    for (size_t i = 0; i < n; i++) {
+        z[i] = std::sqrt(std::fmax(0.0f, 1.0f - x[i] * x[i] - y[i] * y[i]));
+    }
+}
+
+// Random directions and points, drawn from the thread's engine
+
+Vec3 RandomInUnitSphere() {
+    Real u1 = RandomDouble();
+    Real u2 = RandomDouble();
+    return UniformBall(u1, u2, RandomDouble());
+}
+
+Vec3 RandomUnitVector() {
+    Real u1 = RandomDouble();
+    return UniformSphere(u1, RandomDouble());
+}
+
+Vec3 RandomInHemisphere(const Vec3& normal) {
+    Vec3 inUnitSphere = RandomInUnitSphere();
+
+    // Flipping the points of the other hemisphere, a sign select rather than a branch
+    return std::copysign(Real(1), dot(inUnitSphere, normal)) * inUnitSphere;
+}
+
+Vec3 RandomInUnitDisk() {
+    Real u1 = RandomDouble();
+    return ConcentricDisk(u1, RandomDouble());
+}
+
+Vec3 RandomCosineDirection(const Vec3& normal) {
+    Real u1 = RandomDouble();
+    return CosineHemisphere(normal, u1, RandomDouble());
+}
+
+// Low discrepancy sequences for the first dimensions of each sample (pixel position, lens, time in the shutter)
+// Each pixel gets the same sequence randomized by its own scramble, so pixels don't share a pattern and sample s
+// of a pixel only depends on (seed, x, y, s): passes, tiles and threads don't change the image
+enum class SamplerKind { Random, Halton, Sobol };
+
+// Dimensions taken from the sequence, the later ones (bounces) come from the random engine
+const int primarySampleDimensions = 5;
+
+inline double RadicalInverse(uint32_t base, uint64_t index) {
+    double inverseBase = 1.0 / base;
+    double factor = inverseBase;
+    double result = 0.0;
+    while (index > 0) {
+        result += (index % base) * factor;
+        index /= base;
+        factor *= inverseBase;
+    }
+    return result;
+}
+
+// Direction numbers of the first Sobol dimensions (Joe-Kuo), one 32 bit column per bit of the index
+struct SobolMatrices {
+    uint32_t v[primarySampleDimensions][32];
+
+    SobolMatrices() {
+        // Dimension 0 is the van der Corput sequence
+        for (int k = 0; k < 32; k++) {
+            v[0][k] = 1u << (31 - k);
+        }
+        // Degree, polynomial coefficients and initial numbers of dimensions 1 to 4
+        const int degrees[] = { 1, 2, 3, 3 };
+        const uint32_t coefficients[] = { 0, 1, 1, 2 };
+        const uint32_t initial[][3] = { { 1, 0, 0 }, { 1, 3, 0 }, { 1, 3, 1 }, { 1, 1, 1 } };
+        for (int d = 1; d < primarySampleDimensions; d++) {
+            int s = degrees[d - 1];
+            uint32_t a = coefficients[d - 1];
+            for (int k = 0; k < s; k++) {
+                v[d][k] = initial[d - 1][k] << (31 - k);
+            }
+            for (int k = s; k < 32; k++) {
+                uint32_t value = v[d][k - s] ^ (v[d][k - s] >> s);
+                for (int j = 1; j < s; j++) {
+                    value ^= ((a >> (s - 1 - j)) & 1u) * v[d][k - j];
+                }
+                v[d][k] = value;
+            }
+        }
+    }
+};
+
+inline uint32_t SobolBits(int dimension, uint32_t index) {
+    static const SobolMatrices matrices;
+    uint32_t result = 0;
+    for (int k = 0; index != 0; k++, index >>= 1) {
+        result ^= (index & 1u) * matrices.v[dimension][k];
+    }
+    return result;
+}
+
+// Fills the primarySampleDimensions numbers of one sample: Random draws them from the thread's engine (seeded by
+// SeedSample() first), Halton shifts the prime bases 2, 3, 5, 7, 11 by a random offset per pixel (Cranley-Patterson),
+// Sobol xors the bits with a random word per pixel (digital shift, keeps the stratification of the net)
+inline void PrimarySample(SamplerKind kind, uint64_t seed, int x, int y, int sample, double out[primarySampleDimensions]) {
+    if (kind == SamplerKind::Random) {
+        for (int d = 0; d < primarySampleDimensions; d++) {
+            out[d] = RandomDouble();
+        }
+        return;
+    }
+
+    uint64_t state = PixelSeed(seed ^ 0x5A3C96E1F00DBA11ull, x, y);
+    const uint32_t primes[primarySampleDimensions] = { 2, 3, 5, 7, 11 };
+    for (int d = 0; d < primarySampleDimensions; d++) {
+        uint64_t scramble = SplitMix64(state);
+        if (kind == SamplerKind::Halton) {
+            double value = RadicalInverse(primes[d], static_cast<uint64_t>(sample)) + (scramble >> 11) * (1.0 / 9007199254740992.0);
+            out[d] = value >= 1.0 ? value - 1.0 : value;
+        }
+        else {
+            uint32_t bits = SobolBits(d, static_cast<uint32_t>(sample)) ^ static_cast<uint32_t>(scramble >> 32);
+            out[d] = bits * (1.0 / 4294967296.0);
+        }
+    }
+}
+
+#endif //SAMPLING_H
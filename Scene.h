@@ -0,0 +1,132 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Material.h"
+
+// Bump allocator handing out objects that all live until the arena dies, destroyed in reverse order
+// Objects never move, so raw pointers to them stay valid for the whole life of the arena (moves included)
+class Arena {
+    public:
+        static const size_t chunkSize = 64 * 1024;
+
+    private:
+        struct Destructor {
+            void* object;
+            void (*destroy)(void*);
+        };
+
+        std::vector<std::unique_ptr<unsigned char[]>> mChunks;
+        std::vector<Destructor> mDestructors;
+        unsigned char* mCursor = nullptr;
+        size_t mRemaining = 0;
+        size_t mBytesUsed = 0;
+
+    public:
+        Arena() {}
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        Arena(Arena&& other) noexcept { *this = std::move(other); }
+        Arena& operator=(Arena&& other) noexcept {
+            if (this != &other) {
+                Clear();
+                mChunks = std::move(other.mChunks);
+                mDestructors = std::move(other.mDestructors);
+                mCursor = other.mCursor;
+                mRemaining = other.mRemaining;
+                mBytesUsed = other.mBytesUsed;
+                other.mCursor = nullptr;
+                other.mRemaining = 0;
+                other.mBytesUsed = 0;
+            }
+            return *this;
+        }
+        ~Arena() { Clear(); }
+
+        template <typename T, typename... Args>
+        T* Make(Args&&... args) {
+            T* object = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+            mDestructors.push_back({ object, [](void* p) { static_cast<T*>(p)->~T(); } });
+            return object;
+        }
+
+        size_t BytesUsed() const { return mBytesUsed; }
+        size_t ObjectCount() const { return mDestructors.size(); }
+
+        void Clear() {
+            for (auto it = mDestructors.rbegin(); it != mDestructors.rend(); ++it) {
+                it->destroy(it->object);
+            }
+            mDestructors.clear();
+            mChunks.clear();
+            mCursor = nullptr;
+            mRemaining = 0;
+            mBytesUsed = 0;
+        }
+
+    private:
+        void* Allocate(size_t size, size_t alignment) {
+            size_t padding = (alignment - reinterpret_cast<uintptr_t>(mCursor) % alignment) % alignment;
+            if (!mCursor || padding + size > mRemaining) {
+                // Objects larger than a chunk get one of their own
+                size_t capacity = size + alignment > chunkSize ? size + alignment : chunkSize;
+                mChunks.emplace_back(new unsigned char[capacity]);
+                mCursor = mChunks.back().get();
+                mRemaining = capacity;
+                padding = (alignment - reinterpret_cast<uintptr_t>(mCursor) % alignment) % alignment;
+            }
+
+            void* p = mCursor + padding;
+            mCursor += padding + size;
+            mRemaining -= padding + size;
+            mBytesUsed += padding + size;
+            return p;
+        }
+};
+
+// Owns the materials and the primitives of a scene in an arena, hits only carry raw material pointers
+// World() is a HittableList of non owning handles: copying them never touches a reference count
+class Scene {
+    private:
+        Arena mArena;
+        HittableList mWorld;
+
+    public:
+        Scene() {}
+        Scene(const Scene&) = delete;
+        Scene& operator=(const Scene&) = delete;
+        Scene(Scene&&) = default;
+        Scene& operator=(Scene&&) = default;
+
+        template <typename T, typename... Args>
+        T* MakeMaterial(Args&&... args) {
+            return mArena.Make<T>(std::forward<Args>(args)...);
+        }
+
+        // Builds a primitive in the arena and adds it to the world
+        template <typename T, typename... Args>
+        T* Add(Args&&... args) {
+            T* object = mArena.Make<T>(std::forward<Args>(args)...);
+            // Aliasing constructor with an empty owner: a plain pointer behind the shared_ptr interface, without control block
+            mWorld.Add(shared_ptr<Hittable>(shared_ptr<Hittable>(), object));
+            return object;
+        }
+
+        const HittableList& World() const { return mWorld; }
+
+        // Owns whatever else must live as long as the scene
+        Arena& Storage() { return mArena; }
+
+        size_t ArenaBytes() const { return mArena.BytesUsed(); }
+};
+
+#endif //SCENE_H
@@ -0,0 +1,792 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SCENE_FILE_MMAP
+#endif
+
+#include "Utility.h"
+#include "Camera.h"
+#include "Material.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Sphere.h"
+#include "SphereBatch.h"
+
+// Plain records shared by both formats, the binary file is these arrays as they are in memory
+
+struct MaterialRecord {
+    uint32_t kind;
+    // Emitted radiance for lights
+    float albedo[3];
+    double fuzzyness;
+    double refractionIndex;
+};
+
+// The radius stays double like Sphere::mRadius, so a scene gives the same image from a file or from code
+struct SphereRecord {
+    float center[3];
+    uint32_t material;
+    double radius;
+};
+
+struct CameraRecord {
+    double lookFrom[3];
+    double lookAt[3];
+    double vup[3];
+    double verticalFov;
+    double aperture;
+    double focusDistance;
+    // 0 to follow the image size
+    double aspectRatio;
+};
+
+// Keyframes, at times given in frames (fractional frames are allowed), interpolated linearly in between
+struct CameraKeyRecord {
+    double frame;
+    CameraRecord camera;
+};
+
+// Sphere numbers follow the order of the sphere records
+struct SphereKeyRecord {
+    uint32_t sphere;
+    uint32_t pad;
+    double frame;
+    double center[3];
+};
+
+// FNV-1a of the bytes of count values, continuing from hash (only for types without padding bytes)
+const uint64_t hashStart = 14695981039346656037ull;
+template <typename T>
+uint64_t HashBytes(uint64_t hash, const T* values, size_t count = 1) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+    for (size_t i = 0; i < count * sizeof(T); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// Everything a scene file holds, loaded into contiguous arrays
+struct SceneDescription {
+    int imageWidth = 400;
+    int imageHeight = 266;
+    int samplesPerPixel = 500;
+    int maxDepth = 50;
+    uint64_t seed = 0;
+    // Scale of the sky gradient, 0 when the emitters are the only lights
+    double sky = 1.0;
+    CameraRecord camera = { { 13.0, 2.0, 3.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, 20.0, 0.1, 10.0, 0.0 };
+    std::vector<MaterialRecord> materials;
+    std::vector<SphereRecord> spheres;
+    // Animation, still scenes have a single frame and no keys
+    int frameCount = 1;
+    // Fraction of a frame the shutter stays open, 0 for no motion blur
+    double shutter = 0.0;
+    std::vector<CameraKeyRecord> cameraKeys;
+    std::vector<SphereKeyRecord> sphereKeys;
+
+    void Apply(RenderSettings& settings) const {
+        settings.imageWidth = imageWidth;
+        settings.imageHeight = imageHeight;
+        settings.samplesPerPixel = samplesPerPixel;
+        settings.maxDepth = maxDepth;
+        settings.seed = seed;
+        settings.skyIntensity = sky;
+    }
+
+    Camera MakeCamera() const {
+        const CameraRecord& c = camera;
+        return Camera(Vec3(c.lookFrom[0], c.lookFrom[1], c.lookFrom[2]), Vec3(c.lookAt[0], c.lookAt[1], c.lookAt[2]), Vec3(c.vup[0], c.vup[1], c.vup[2]),
+                      c.verticalFov, c.aspectRatio > 0.0 ? c.aspectRatio : double(imageWidth) / imageHeight, c.aperture, c.focusDistance);
+    }
+
+    // What the objects and their motion look like, the settings and the camera aside
+    uint64_t Hash() const {
+        uint64_t hash = HashBytes(hashStart, materials.data(), materials.size());
+        hash = HashBytes(hash, spheres.data(), spheres.size());
+        hash = HashBytes(hash, cameraKeys.data(), cameraKeys.size());
+        // The pad of the sphere keys isn't always set
+        for (const SphereKeyRecord& k : sphereKeys) {
+            hash = HashBytes(hash, &k.sphere);
+            hash = HashBytes(hash, &k.frame);
+            hash = HashBytes(hash, k.center, 3);
+        }
+        return hash;
+    }
+
+    // Heap bytes of the arrays
+    size_t MemoryFootprint() const {
+        return materials.size() * sizeof(MaterialRecord) + spheres.size() * sizeof(SphereRecord)
+            + cameraKeys.size() * sizeof(CameraKeyRecord) + sphereKeys.size() * sizeof(SphereKeyRecord);
+    }
+};
+
+// Materials of a description built in arena, in the order of the records
+std::vector<const Material*> MakeMaterials(const SceneDescription& description, Arena& arena) {
+    std::vector<const Material*> materials;
+    materials.reserve(description.materials.size());
+
+    for (const MaterialRecord& m : description.materials) {
+        Vec3 albedo(m.albedo[0], m.albedo[1], m.albedo[2]);
+        switch (static_cast<MaterialKind>(m.kind)) {
+            case MaterialKind::Metal: materials.push_back(arena.Make<Metal>(albedo, m.fuzzyness)); break;
+            case MaterialKind::Dielectric: materials.push_back(arena.Make<Dielectric>(m.refractionIndex)); break;
+            case MaterialKind::DiffuseLight: materials.push_back(arena.Make<DiffuseLight>(albedo)); break;
+            default: materials.push_back(arena.Make<Lambertian>(albedo)); break;
+        }
+    }
+
+    return materials;
+}
+
+// One Sphere object per record, for the structures working on a HittableList
+Scene BuildScene(const SceneDescription& description) {
+    Scene scene;
+    std::vector<const Material*> materials = MakeMaterials(description, scene.Storage());
+
+    for (const SphereRecord& s : description.spheres) {
+        scene.Add<Sphere>(Vec3(s.center[0], s.center[1], s.center[2]), s.radius, materials[s.material]);
+    }
+
+    return scene;
+}
+
+// Straight into the structure of arrays, without any per sphere object
+SphereBatch BuildSphereBatch(const SceneDescription& description, const std::vector<const Material*>& materials) {
+    SphereBatch batch;
+    batch.Reserve(description.spheres.size());
+    for (const SphereRecord& s : description.spheres) {
+        batch.Add(Vec3(s.center[0], s.center[1], s.center[2]), s.radius, materials[s.material]);
+    }
+    return batch;
+}
+
+// Text format, one statement per line, # starts a comment:
+//   image <width> <height>
+//   samples <per pixel>
+//   depth <max bounces>
+//   seed <n>
+//   sky <intensity>                     (scale of the sky gradient, 0 for scenes lit by their emitters only)
+//   camera <from x y z> <at x y z> <up x y z> <vertical fov> <aperture> <focus distance>
+//   aspect <ratio>                      (of the camera, the image size gives it by default)
+//   material <name> lambertian <r g b>
+//   material <name> metal <r g b> <fuzzyness>
+//   material <name> dielectric <refraction index>
+//   material <name> light <r g b>       (emitted radiance, may exceed 1)
+//   sphere <x y z> <radius> <material name>
+//   frames <count>                      (of the animation)
+//   shutter <fraction of a frame>       (motion blur, 0 by default)
+//   camera-key <frame> <from x y z> <at x y z> <up x y z> <vertical fov> <aperture> <focus distance>
+//   sphere-key <sphere number> <frame> <x y z>   (spheres are numbered from 0 in the order of the file)
+// Materials must be declared before the spheres using them, spheres before their keys
+class SceneTextParser {
+    private:
+        const char* mCursor;
+        const char* mEnd;
+        int mLine = 1;
+        bool mFailed = false;
+        std::string mPath;
+
+    public:
+        SceneTextParser(const std::string& path, const std::string& text) : mCursor(text.data()), mEnd(text.data() + text.size()), mPath(path) {}
+
+        bool Parse(SceneDescription& description) {
+            std::unordered_map<std::string, uint32_t> materialNames;
+            std::string keyword;
+
+            while (!mFailed && NextStatement(keyword)) {
+                if (keyword == "image") {
+                    description.imageWidth = static_cast<int>(Integer());
+                    description.imageHeight = static_cast<int>(Integer());
+                    if (description.imageWidth < 1 || description.imageHeight < 1) {
+                        return Error("the image needs at least one pixel on each side");
+                    }
+                }
+                else if (keyword == "samples") {
+                    description.samplesPerPixel = static_cast<int>(Integer());
+                    if (description.samplesPerPixel < 1) {
+                        return Error("a pixel needs at least one sample");
+                    }
+                }
+                else if (keyword == "depth") {
+                    description.maxDepth = static_cast<int>(Integer());
+                }
+                else if (keyword == "seed") {
+                    description.seed = static_cast<uint64_t>(Integer());
+                }
+                else if (keyword == "sky") {
+                    description.sky = Double();
+                }
+                else if (keyword == "camera") {
+                    CameraFields(description.camera);
+                }
+                else if (keyword == "frames") {
+                    description.frameCount = static_cast<int>(Integer());
+                    if (description.frameCount < 1) {
+                        return Error("an animation needs at least one frame");
+                    }
+                }
+                else if (keyword == "shutter") {
+                    description.shutter = Double();
+                    if (description.shutter < 0.0) {
+                        return Error("the shutter can't be negative");
+                    }
+                }
+                else if (keyword == "camera-key") {
+                    CameraKeyRecord key;
+                    key.frame = Double();
+                    // The aspect ratio isn't animated
+                    key.camera = description.camera;
+                    CameraFields(key.camera);
+                    description.cameraKeys.push_back(key);
+                }
+                else if (keyword == "sphere-key") {
+                    SphereKeyRecord key;
+                    key.sphere = static_cast<uint32_t>(Integer());
+                    key.pad = 0;
+                    key.frame = Double();
+                    Floats(key.center, 3);
+                    if (key.sphere >= description.spheres.size()) {
+                        return Error("sphere-key for sphere " + std::to_string(key.sphere) + ", which isn't declared");
+                    }
+                    description.sphereKeys.push_back(key);
+                }
+                else if (keyword == "aspect") {
+                    description.camera.aspectRatio = Double();
+                }
+                else if (keyword == "material") {
+                    std::string name;
+                    std::string kind;
+                    Word(name);
+                    Word(kind);
+
+                    MaterialRecord m = { 0, { 0.0f, 0.0f, 0.0f }, 0.0, 1.0 };
+                    if (kind == "lambertian") {
+                        m.kind = static_cast<uint32_t>(MaterialKind::Lambertian);
+                        Floats(m.albedo, 3);
+                    }
+                    else if (kind == "metal") {
+                        m.kind = static_cast<uint32_t>(MaterialKind::Metal);
+                        Floats(m.albedo, 3);
+                        m.fuzzyness = Double();
+                    }
+                    else if (kind == "dielectric") {
+                        m.kind = static_cast<uint32_t>(MaterialKind::Dielectric);
+                        m.refractionIndex = Double();
+                    }
+                    else if (kind == "light") {
+                        m.kind = static_cast<uint32_t>(MaterialKind::DiffuseLight);
+                        Floats(m.albedo, 3);
+                    }
+                    else {
+                        return Error("unknown material kind " + kind);
+                    }
+
+                    materialNames[name] = static_cast<uint32_t>(description.materials.size());
+                    description.materials.push_back(m);
+                }
+                else if (keyword == "sphere") {
+                    SphereRecord s;
+                    Floats(s.center, 3);
+                    s.radius = Double();
+
+                    std::string name;
+                    Word(name);
+                    auto material = materialNames.find(name);
+                    if (material == materialNames.end()) {
+                        return Error("unknown material " + name);
+                    }
+                    s.material = material->second;
+                    description.spheres.push_back(s);
+                }
+                else {
+                    return Error("unknown statement " + keyword);
+                }
+
+                SkipLine();
+            }
+
+            return !mFailed;
+        }
+
+    private:
+        void CameraFields(CameraRecord& c) {
+            Floats(c.lookFrom, 3);
+            Floats(c.lookAt, 3);
+            Floats(c.vup, 3);
+            c.verticalFov = Double();
+            c.aperture = Double();
+            c.focusDistance = Double();
+        }
+
+        // Only the first error is reported, the ones after it follow from it
+        bool Error(const std::string& message) {
+            if (!mFailed) {
+                std::cerr << mPath << ":" << mLine << ": " << message << "\n";
+            }
+            mFailed = true;
+            return false;
+        }
+
+        // Skips blanks and comments, stops at the end of the line so statements can't run over several lines
+        void SkipBlanks() {
+            while (mCursor < mEnd && (*mCursor == ' ' || *mCursor == '\t' || *mCursor == '\r')) {
+                mCursor++;
+            }
+            if (mCursor < mEnd && *mCursor == '#') {
+                while (mCursor < mEnd && *mCursor != '\n') {
+                    mCursor++;
+                }
+            }
+        }
+
+        void SkipLine() {
+            SkipBlanks();
+            if (mCursor < mEnd && *mCursor != '\n') {
+                Error("unexpected text at the end of the statement");
+                return;
+            }
+            if (mCursor < mEnd) {
+                mCursor++;
+                mLine++;
+            }
+        }
+
+        // First word of the next statement, blank lines skipped
+        bool NextStatement(std::string& keyword) {
+            SkipBlanks();
+            while (mCursor < mEnd && *mCursor == '\n') {
+                mCursor++;
+                mLine++;
+                SkipBlanks();
+            }
+            return Word(keyword);
+        }
+
+        // Next word of the current line
+        bool Word(std::string& word) {
+            SkipBlanks();
+            const char* start = mCursor;
+            while (mCursor < mEnd && !isspace(static_cast<unsigned char>(*mCursor)) && *mCursor != '#') {
+                mCursor++;
+            }
+            word.assign(start, mCursor);
+            return !word.empty();
+        }
+
+        double Double() {
+            SkipBlanks();
+            char* end = nullptr;
+            // strtod would go over the end of the line
+            double value = mCursor < mEnd && *mCursor != '\n' ? strtod(mCursor, &end) : 0.0;
+            if (end == nullptr || end == mCursor) {
+                Error("number expected");
+                return 0.0f;
+            }
+            mCursor = end;
+            return value;
+        }
+
+        long long Integer() {
+            SkipBlanks();
+            char* end = nullptr;
+            long long value = mCursor < mEnd && *mCursor != '\n' ? strtoll(mCursor, &end, 10) : 0;
+            if (end == nullptr || end == mCursor) {
+                Error("integer expected");
+                return 0;
+            }
+            mCursor = end;
+            return value;
+        }
+
+        template <typename T>
+        void Floats(T* values, int count) {
+            for (int i = 0; i < count; i++) {
+                values[i] = static_cast<T>(Double());
+            }
+        }
+};
+
+// The whole file in memory, mapped when the system allows it
+class MappedFile {
+    private:
+        const unsigned char* mData = nullptr;
+        size_t mSize = 0;
+        std::vector<unsigned char> mBuffer;
+#if defined(SCENE_FILE_MMAP)
+        void* mMapping = nullptr;
+#endif
+
+    public:
+        MappedFile(const std::string& path) {
+#if defined(SCENE_FILE_MMAP)
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return;
+            }
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED) {
+                    mMapping = mapping;
+                    mData = static_cast<const unsigned char*>(mapping);
+                    mSize = static_cast<size_t>(info.st_size);
+                }
+            }
+            close(fd);
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                return;
+            }
+            mBuffer.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(mBuffer.data()), mBuffer.size());
+            mData = mBuffer.data();
+            mSize = mBuffer.size();
+#endif
+        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        ~MappedFile() {
+#if defined(SCENE_FILE_MMAP)
+            if (mMapping) {
+                munmap(mMapping, mSize);
+            }
+#endif
+        }
+
+        bool IsOpen() const { return mData != nullptr; }
+        const unsigned char* Data() const { return mData; }
+        size_t Size() const { return mSize; }
+};
+
+// Binary format: this header, the material records then the sphere records, in the byte order of the machine
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t imageWidth;
+    int32_t imageHeight;
+    int32_t samplesPerPixel;
+    int32_t maxDepth;
+    uint32_t pad;
+    uint64_t seed;
+    CameraRecord camera;
+    uint64_t materialCount;
+    uint64_t sphereCount;
+    int32_t frameCount;
+    uint32_t pad2;
+    double shutter;
+    uint64_t cameraKeyCount;
+    uint64_t sphereKeyCount;
+    double sky;
+
+    // 2: animation, the key records follow the spheres
+    // 3: sky intensity, light materials
+    static const uint32_t currentVersion = 3;
+};
+
+bool SaveSceneBinary(const std::string& path, const SceneDescription& description) {
+    SceneFileHeader header;
+    std::memcpy(header.magic, "RTSCENE\0", sizeof(header.magic));
+    header.version = SceneFileHeader::currentVersion;
+    header.imageWidth = description.imageWidth;
+    header.imageHeight = description.imageHeight;
+    header.samplesPerPixel = description.samplesPerPixel;
+    header.maxDepth = description.maxDepth;
+    header.pad = 0;
+    header.seed = description.seed;
+    header.camera = description.camera;
+    header.materialCount = description.materials.size();
+    header.sphereCount = description.spheres.size();
+    header.frameCount = description.frameCount;
+    header.pad2 = 0;
+    header.shutter = description.shutter;
+    header.cameraKeyCount = description.cameraKeys.size();
+    header.sphereKeyCount = description.sphereKeys.size();
+    header.sky = description.sky;
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(description.materials.data()), description.materials.size() * sizeof(MaterialRecord));
+    file.write(reinterpret_cast<const char*>(description.spheres.data()), description.spheres.size() * sizeof(SphereRecord));
+    file.write(reinterpret_cast<const char*>(description.cameraKeys.data()), description.cameraKeys.size() * sizeof(CameraKeyRecord));
+    file.write(reinterpret_cast<const char*>(description.sphereKeys.data()), description.sphereKeys.size() * sizeof(SphereKeyRecord));
+    return static_cast<bool>(file);
+}
+
+bool LoadSceneBinary(const std::string& path, SceneDescription& description) {
+    MappedFile file(path);
+    if (!file.IsOpen() || file.Size() < sizeof(SceneFileHeader)) {
+        std::cerr << "Can't read scene " << path << ".\n";
+        return false;
+    }
+
+    SceneFileHeader header;
+    std::memcpy(&header, file.Data(), sizeof(header));
+    if (std::memcmp(header.magic, "RTSCENE\0", sizeof(header.magic)) != 0 || header.version != SceneFileHeader::currentVersion) {
+        std::cerr << path << " is not a binary scene of this version.\n";
+        return false;
+    }
+    if (header.imageWidth < 1 || header.imageHeight < 1 || header.samplesPerPixel < 1) {
+        std::cerr << "Scene " << path << " has no pixel or no sample per pixel.\n";
+        return false;
+    }
+    if (header.frameCount < 1 || !(header.shutter >= 0.0)) {
+        std::cerr << "Scene " << path << " has no frame or a negative shutter.\n";
+        return false;
+    }
+
+    // Each count is checked against the bytes left before being multiplied, so a huge count can't wrap around
+    size_t remaining = file.Size() - sizeof(header);
+    auto take = [&remaining](uint64_t count, size_t recordSize, size_t& bytes) {
+        if (count > remaining / recordSize) {
+            return false;
+        }
+        bytes = static_cast<size_t>(count) * recordSize;
+        remaining -= bytes;
+        return true;
+    };
+    size_t materialBytes = 0;
+    size_t sphereBytes = 0;
+    size_t cameraKeyBytes = 0;
+    size_t sphereKeyBytes = 0;
+    if (!take(header.materialCount, sizeof(MaterialRecord), materialBytes) || !take(header.sphereCount, sizeof(SphereRecord), sphereBytes) ||
+        !take(header.cameraKeyCount, sizeof(CameraKeyRecord), cameraKeyBytes) || !take(header.sphereKeyCount, sizeof(SphereKeyRecord), sphereKeyBytes)) {
+        std::cerr << "Scene " << path << " is truncated.\n";
+        return false;
+    }
+
+    description.imageWidth = header.imageWidth;
+    description.imageHeight = header.imageHeight;
+    description.samplesPerPixel = header.samplesPerPixel;
+    description.maxDepth = header.maxDepth;
+    description.seed = header.seed;
+    description.sky = header.sky;
+    description.camera = header.camera;
+
+    // The records are laid out as in memory, loading is two copies out of the mapping
+    const unsigned char* data = file.Data() + sizeof(header);
+    description.materials.resize(header.materialCount);
+    std::memcpy(description.materials.data(), data, materialBytes);
+    description.spheres.resize(header.sphereCount);
+    std::memcpy(description.spheres.data(), data + materialBytes, sphereBytes);
+    description.frameCount = header.frameCount;
+    description.shutter = header.shutter;
+    description.cameraKeys.resize(header.cameraKeyCount);
+    std::memcpy(description.cameraKeys.data(), data + materialBytes + sphereBytes, cameraKeyBytes);
+    description.sphereKeys.resize(header.sphereKeyCount);
+    std::memcpy(description.sphereKeys.data(), data + materialBytes + sphereBytes + cameraKeyBytes, sphereKeyBytes);
+
+    for (const SphereRecord& s : description.spheres) {
+        if (s.material >= description.materials.size()) {
+            std::cerr << "Scene " << path << " has a sphere with an unknown material.\n";
+            return false;
+        }
+    }
+    for (const SphereKeyRecord& k : description.sphereKeys) {
+        if (k.sphere >= description.spheres.size()) {
+            std::cerr << "Scene " << path << " has a key for an unknown sphere.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SaveSceneText(const std::string& path, const SceneDescription& description) {
+    std::ofstream file(path);
+    file << std::setprecision(17);
+    file << "image " << description.imageWidth << " " << description.imageHeight << "\n"
+         << "samples " << description.samplesPerPixel << "\n"
+         << "depth " << description.maxDepth << "\n"
+         << "seed " << description.seed << "\n";
+    if (description.sky != 1.0) {
+        file << "sky " << description.sky << "\n";
+    }
+
+    auto writeCamera = [&](const CameraRecord& c) {
+        file << c.lookFrom[0] << " " << c.lookFrom[1] << " " << c.lookFrom[2] << "  "
+             << c.lookAt[0] << " " << c.lookAt[1] << " " << c.lookAt[2] << "  "
+             << c.vup[0] << " " << c.vup[1] << " " << c.vup[2] << "  "
+             << c.verticalFov << " " << c.aperture << " " << c.focusDistance << "\n";
+    };
+    const CameraRecord& c = description.camera;
+    file << "camera ";
+    writeCamera(c);
+    if (c.aspectRatio > 0.0) {
+        file << "aspect " << c.aspectRatio << "\n";
+    }
+
+    for (size_t i = 0; i < description.materials.size(); i++) {
+        const MaterialRecord& m = description.materials[i];
+        file << "material m" << i << " ";
+        switch (static_cast<MaterialKind>(m.kind)) {
+            case MaterialKind::Metal: file << "metal " << m.albedo[0] << " " << m.albedo[1] << " " << m.albedo[2] << " " << m.fuzzyness; break;
+            case MaterialKind::Dielectric: file << "dielectric " << m.refractionIndex; break;
+            case MaterialKind::DiffuseLight: file << "light " << m.albedo[0] << " " << m.albedo[1] << " " << m.albedo[2]; break;
+            default: file << "lambertian " << m.albedo[0] << " " << m.albedo[1] << " " << m.albedo[2]; break;
+        }
+        file << "\n";
+    }
+
+    for (const SphereRecord& s : description.spheres) {
+        file << "sphere " << s.center[0] << " " << s.center[1] << " " << s.center[2] << " " << s.radius << " m" << s.material << "\n";
+    }
+
+    if (description.frameCount != 1) {
+        file << "frames " << description.frameCount << "\n";
+    }
+    if (description.shutter > 0.0) {
+        file << "shutter " << description.shutter << "\n";
+    }
+    for (const CameraKeyRecord& k : description.cameraKeys) {
+        file << "camera-key " << k.frame << "  ";
+        writeCamera(k.camera);
+    }
+    for (const SphereKeyRecord& k : description.sphereKeys) {
+        file << "sphere-key " << k.sphere << " " << k.frame << " " << k.center[0] << " " << k.center[1] << " " << k.center[2] << "\n";
+    }
+
+    return static_cast<bool>(file);
+}
+
+bool LoadSceneText(const std::string& path, SceneDescription& description) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Can't read scene " << path << ".\n";
+        return false;
+    }
+
+    std::ostringstream text;
+    text << file.rdbuf();
+    return SceneTextParser(path, text.str()).Parse(description);
+}
+
+// .sceneb files are binary, anything else is text
+bool LoadScene(const std::string& path, SceneDescription& description) {
+    bool binary = path.size() > 7 && path.compare(path.size() - 7, 7, ".sceneb") == 0;
+    return binary ? LoadSceneBinary(path, description) : LoadSceneText(path, description);
+}
+
+// Peak resident memory of the process, resettable on Linux only (0 where it can't be measured)
+void ResetPeakMemory() {
+#if defined(__linux__)
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+#endif
+}
+
+size_t PeakMemoryBytes() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return static_cast<size_t>(std::strtoull(line.c_str() + 6, nullptr, 10)) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+size_t CurrentMemoryBytes() {
+#if defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0) {
+            return static_cast<size_t>(std::strtoull(line.c_str() + 6, nullptr, 10)) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+// sphereCount small spheres over a ground sphere, with a handful of materials
+SceneDescription RandomSpheresDescription(size_t sphereCount) {
+    SceneDescription description;
+    description.materials.push_back({ static_cast<uint32_t>(MaterialKind::Lambertian), { 0.5f, 0.5f, 0.5f }, 0.0, 1.0 });
+    description.materials.push_back({ static_cast<uint32_t>(MaterialKind::Lambertian), { 0.4f, 0.2f, 0.1f }, 0.0, 1.0 });
+    description.materials.push_back({ static_cast<uint32_t>(MaterialKind::Metal), { 0.7f, 0.6f, 0.5f }, 0.1, 1.0 });
+    description.materials.push_back({ static_cast<uint32_t>(MaterialKind::Dielectric), { 1.0f, 1.0f, 1.0f }, 0.0, 1.5 });
+
+    SeedRandom(description.seed, 1);
+    description.spheres.reserve(sphereCount + 1);
+    description.spheres.push_back({ { 0.0f, -1000.0f, 0.0f }, 0, 1000.0 });
+
+    // Spread over a square whose area grows with the count so the density stays the same
+    float half = static_cast<float>(0.5 * sqrt(double(sphereCount)));
+    for (size_t i = 0; i < sphereCount; i++) {
+        float x = static_cast<float>(RandomDouble(-half, half));
+        float z = static_cast<float>(RandomDouble(-half, half));
+        description.spheres.push_back({ { x, 0.2f, z }, static_cast<uint32_t>(RandomDouble() * 4.0), 0.2 });
+    }
+
+    return description;
+}
+
+// Parse (or load) time and memory of a scene of sphereCount spheres in both formats, up to a SphereBvh ready to trace
+void RunSceneLoadBenchmark(std::ostream& out, size_t sphereCount = 1000000) {
+    const std::string textPath = "scene_benchmark.scene";
+    const std::string binaryPath = "scene_benchmark.sceneb";
+    {
+        SceneDescription description = RandomSpheresDescription(sphereCount);
+        SaveSceneText(textPath, description);
+        SaveSceneBinary(binaryPath, description);
+    }
+
+    double millions = sphereCount / 1e6;
+    out << "Scene load (" << sphereCount << " spheres):\n";
+
+    for (const std::string& path : { binaryPath, textPath }) {
+        size_t baseline = CurrentMemoryBytes();
+        ResetPeakMemory();
+
+        auto start = std::chrono::steady_clock::now();
+        SceneDescription description;
+        LoadScene(path, description);
+        auto loaded = std::chrono::steady_clock::now();
+
+        Arena arena;
+        SphereBatch batch = BuildSphereBatch(description, MakeMaterials(description, arena));
+        auto built = std::chrono::steady_clock::now();
+        SphereBvh bvh(batch);
+        auto end = std::chrono::steady_clock::now();
+
+        size_t peak = PeakMemoryBytes();
+        double loadMs = std::chrono::duration<double, std::milli>(loaded - start).count();
+        double batchMs = std::chrono::duration<double, std::milli>(built - loaded).count();
+        double bvhMs = std::chrono::duration<double, std::milli>(end - built).count();
+
+        out << "  " << path << ": load " << loadMs / millions << " ms, arrays " << batchMs / millions << " ms, BVH " << bvhMs / millions
+            << " ms per million spheres";
+        if (peak > baseline) {
+            out << ", peak memory " << (peak - baseline) / millions / (1024.0 * 1024.0) << " MiB per million spheres";
+        }
+        out << "\n";
+    }
+
+    std::remove(textPath.c_str());
+    std::remove(binaryPath.c_str());
+}
+
+#endif //SCENE_FILE_H
@@ -2,36 +2,48 @@
 #define SPHERE_H
 
 #include "Hittable.h"
+#include "Profiler.h"
 
 class Sphere : public Hittable {
     public :
+        // Center when the shutter opens, it moves by mMotion until the shutter closes (motion blur)
         Vec3 mCenter;
-        double mRadius;
-        shared_ptr<Material> mMatPtr;
+        Vec3 mMotion = Vec3(0, 0, 0);
+        Real mRadius;
+        const Material* mMatPtr;
+        // Keeps the material alive when the sphere was given a shared one, empty when the material lives in a Scene
+        shared_ptr<Material> mMatOwner;
 
     public :
         Sphere() {}
-        Sphere(Vec3 center, double radius, shared_ptr<Material> mat) : mCenter(center), mRadius(radius), mMatPtr(mat) {};
-        virtual bool Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) const override;
+        Sphere(Vec3 center, Real radius, shared_ptr<Material> mat) : mCenter(center), mRadius(radius), mMatPtr(mat.get()), mMatOwner(mat) {};
+        Sphere(Vec3 center, Real radius, const Material* mat) : mCenter(center), mRadius(radius), mMatPtr(mat) {};
+        virtual bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const override;
+        virtual bool BoundingBox(Aabb& outputBox) const override;
+
+        Vec3 CenterAt(Real time) const { return mCenter + time * mMotion; }
 };
 
-bool Sphere::Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) const {
+// Shared by Sphere and SphereBatch so both give exactly the same hits
+inline bool HitSphere(const Vec3& center, Real radius, const Material* mat, const Ray& r, Real tMin, Real tMax, HitRecord& rec) {
+    PROFILE_COUNT(sphereCalls);
+
     // b becomes half_b when considering b as 2h, implies this*
-    Vec3 originToCenter = r.origin() - mCenter;
-    double a = r.direction().squaredLength();
-    double half_b = dot(originToCenter, r.direction());
-    double c = originToCenter.squaredLength() - mRadius*mRadius;
-    double delta = half_b*half_b - a*c;
+    Vec3 originToCenter = r.origin() - center;
+    Real a = r.direction().squaredLength();
+    Real half_b = dot(originToCenter, r.direction());
+    Real c = originToCenter.squaredLength() - radius*radius;
+    Real delta = half_b*half_b - a*c;
 
     if (delta < 0) {
         return false;
     } 
     
-    double sqrtDelta = sqrt(delta);
+    Real sqrtDelta = sqrt(delta);
 
     // Find the nearest root that lies in the acceptable range
     // *Simplifies this
-    double root = (-half_b - sqrtDelta) / a;
+    Real root = (-half_b - sqrtDelta) / a;
     if (root < tMin || tMax < root) {
         root = (-half_b + sqrtDelta) / a;
         
@@ -42,9 +54,24 @@ bool Sphere::Hit(const Ray& r, double tMin, double tMax, HitRecord& rec) const {
 
     rec.t = root;
     rec.p = r.point_at_parameter(rec.t);
-    Vec3 outwardNormal = (rec.p - mCenter) / mRadius;
+    Vec3 outwardNormal = (rec.p - center) / radius;
     rec.SetFaceNormal(r, outwardNormal);
-    rec.materialPtr = mMatPtr;
+    rec.materialPtr = mat;
+
+    PROFILE_COUNT(sphereHits);
+    return true;
+}
+
+bool Sphere::Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const {
+    return HitSphere(CenterAt(r.time()), mRadius, mMatPtr, r, tMin, tMax, rec);
+}
+
+bool Sphere::BoundingBox(Aabb& outputBox) const {
+    // The radius is negative for hollow spheres, the box holds the whole motion
+    Real radius = std::fabs(mRadius);
+    Vec3 extent(radius, radius, radius);
+    outputBox = Aabb(mCenter - extent, mCenter + extent);
+    outputBox.Grow(Aabb(mCenter + mMotion - extent, mCenter + mMotion + extent));
 
     return true;
 }
@@ -0,0 +1,343 @@
+#ifndef SPHERE_BATCH_H
+#define SPHERE_BATCH_H
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "Hittable.h"
+#include "HittableList.h"
+#include "Sphere.h"
+#include "FlatBvh.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SPHERE_BATCH_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SPHERE_BATCH_SSE
+#endif
+
+// Spheres stored as a structure of arrays and tested several at a time
+// The SIMD kernel only culls: lanes it keeps are checked again with HitSphere(), so hits are exactly the ones of Sphere::Hit
+class SphereBatch : public Hittable {
+    public:
+#if defined(SPHERE_BATCH_AVX)
+        static const int laneCount = 8;
+#elif defined(SPHERE_BATCH_SSE)
+        static const int laneCount = 4;
+#else
+        static const int laneCount = 1;
+#endif
+        // Used when the batch is the leaf storage of a FlatBvhT
+        static const int maxLeafSize = laneCount > 4 ? laneCount : 4;
+
+    private:
+        size_t mCount = 0;
+        // Hot data read by the kernel, padded with laneCount - 1 zeros so the last block can always be loaded whole
+        std::vector<float> mCenterX;
+        std::vector<float> mCenterY;
+        std::vector<float> mCenterZ;
+        std::vector<float> mRadius;
+        // Motion over the shutter interval, padded like the centers, empty until a sphere moves so still scenes
+        // neither store nor read it
+        std::vector<float> mMotionX;
+        std::vector<float> mMotionY;
+        std::vector<float> mMotionZ;
+        // Cold data, only read for the lanes that pass the kernel
+        std::vector<Real> mExactRadius;
+#ifdef RAYTRACER_DOUBLE
+        // The float centers of the kernel would make double hits less precise than Sphere's
+        std::vector<Vec3> mExactCenter;
+#endif
+        std::vector<const Material*> mMaterials;
+        // Shared materials of the spheres the batch was built from, kept alive for the batch
+        std::vector<shared_ptr<Material>> mMaterialOwners;
+
+    public:
+        SphereBatch() { Pad(); }
+        // Left empty when the objects aren't all spheres: a batch missing some of them would no longer match the
+        // BVH nodes computed over the whole list
+        SphereBatch(const std::vector<shared_ptr<Hittable>>& objects) {
+            Pad();
+            if (!CanHold(objects)) {
+                std::cerr << "SphereBatch only holds spheres, batch left empty.\n";
+                return;
+            }
+            for (const auto& object : objects) {
+                const Sphere* sphere = static_cast<const Sphere*>(object.get());
+                Add(sphere->mCenter, sphere->mRadius, sphere->mMatPtr);
+                if (!sphere->mMotion.NearZero()) {
+                    SetMotion(mCount - 1, sphere->mMotion);
+                }
+                if (sphere->mMatOwner) {
+                    mMaterialOwners.push_back(sphere->mMatOwner);
+                }
+            }
+        }
+        SphereBatch(const HittableList& list) : SphereBatch(list.objects) {}
+
+        // Whether every object is a Sphere, checked by FlatBvhT before building a tree over a list
+        static bool CanHold(const std::vector<shared_ptr<Hittable>>& objects) {
+            return std::all_of(objects.begin(), objects.end(), [](const shared_ptr<Hittable>& object) { return dynamic_cast<const Sphere*>(object.get()) != nullptr; });
+        }
+
+        void Add(const Vec3& center, Real radius, const Material* mat) {
+            size_t i = mCount++;
+            Pad();
+
+            // Slot i used to be padding
+            mCenterX[i] = center.x();
+            mCenterY[i] = center.y();
+            mCenterZ[i] = center.z();
+            mRadius[i] = static_cast<float>(radius);
+            mExactRadius.push_back(radius);
+#ifdef RAYTRACER_DOUBLE
+            mExactCenter.push_back(center);
+#endif
+            mMaterials.push_back(mat);
+        }
+
+        // Moves sphere i, the BVH over the batch must be refit afterwards
+        void SetCenter(size_t i, const Vec3& center) {
+            mCenterX[i] = center.x();
+            mCenterY[i] = center.y();
+            mCenterZ[i] = center.z();
+#ifdef RAYTRACER_DOUBLE
+            mExactCenter[i] = center;
+#endif
+        }
+
+        // Displacement of sphere i between shutter open and close
+        void SetMotion(size_t i, const Vec3& motion) {
+            if (mMotionX.empty()) {
+                if (motion.NearZero()) {
+                    return;
+                }
+                for (std::vector<float>* hot : { &mMotionX, &mMotionY, &mMotionZ }) {
+                    hot->assign(mCenterX.size(), 0.0f);
+                }
+            }
+            mMotionX[i] = motion.x();
+            mMotionY[i] = motion.y();
+            mMotionZ[i] = motion.z();
+        }
+
+        bool Moving() const { return !mMotionX.empty(); }
+
+        Vec3 Motion(size_t i) const { return Moving() ? Vec3(mMotionX[i], mMotionY[i], mMotionZ[i]) : Vec3(0, 0, 0); }
+
+        void Reserve(size_t count) {
+            for (std::vector<float>* hot : { &mCenterX, &mCenterY, &mCenterZ, &mRadius }) {
+                hot->reserve(count + laneCount - 1);
+            }
+            mExactRadius.reserve(count);
+#ifdef RAYTRACER_DOUBLE
+            mExactCenter.reserve(count);
+#endif
+            mMaterials.reserve(count);
+        }
+
+        size_t Size() const { return mCount; }
+
+        size_t MemoryFootprint() const { return (4 * mCenterX.size() + 3 * mMotionX.size()) * sizeof(float); }
+
+#ifdef RAYTRACER_DOUBLE
+        Vec3 Center(size_t i) const { return mExactCenter[i]; }
+#else
+        Vec3 Center(size_t i) const { return Vec3(mCenterX[i], mCenterY[i], mCenterZ[i]); }
+#endif
+        Real Radius(size_t i) const { return mExactRadius[i]; }
+        const Material* MaterialOf(size_t i) const { return mMaterials[i]; }
+
+        // Holds the sphere over the whole shutter interval
+        Aabb Box(size_t i) const {
+            Real radius = std::fabs(mExactRadius[i]);
+            Vec3 extent(radius, radius, radius);
+            Aabb box(Center(i) - extent, Center(i) + extent);
+            if (Moving()) {
+                box.Grow(Aabb(Center(i) + Motion(i) - extent, Center(i) + Motion(i) + extent));
+            }
+            return box;
+        }
+
+        // Sphere i of the result is sphere order[i] of this batch
+        SphereBatch Reordered(const std::vector<size_t>& order) const {
+            SphereBatch batch;
+            batch.Reserve(order.size());
+            for (size_t i : order) {
+                batch.Add(Center(i), mExactRadius[i], mMaterials[i]);
+                if (Moving()) {
+                    batch.SetMotion(batch.Size() - 1, Motion(i));
+                }
+            }
+            batch.mMaterialOwners = mMaterialOwners;
+            return batch;
+        }
+
+        virtual bool Hit(const Ray& r, Real tMin, Real tMax, HitRecord& rec) const override {
+            return HitRange(r, 0, mCount, tMin, tMax, rec);
+        }
+
+        virtual bool BoundingBox(Aabb& outputBox) const override {
+            if (mCount == 0) {
+                return false;
+            }
+
+            outputBox = Aabb();
+            for (size_t i = 0; i < mCount; i++) {
+                outputBox.Grow(Box(i));
+            }
+            return true;
+        }
+
+        // Nearest hit among the spheres [first, first + count[
+        bool HitRange(const Ray& r, size_t first, size_t count, Real tMin, Real tMax, HitRecord& rec) const {
+            bool hitAnything = false;
+            size_t end = first + count;
+
+#if defined(SPHERE_BATCH_AVX) || defined(SPHERE_BATCH_SSE)
+            Vec3 origin = r.origin();
+            Vec3 direction = r.direction();
+            float a = direction.squaredLength();
+            float invA = 1.0f / a;
+            // Float math is looser than the exact test, the kernel widens everything a bit so it never drops a real hit
+            const float slack = 1e-4f;
+            float tMinLoose = static_cast<float>(tMin) - slack;
+
+            for (size_t i = first; i < end; i += laneCount) {
+                float tMaxLoose = static_cast<float>(tMax) * (1.0f + slack) + slack;
+                int mask = CandidateLanes(i, origin, direction, static_cast<float>(r.time()), a, invA, tMinLoose, tMaxLoose);
+
+                // Lanes past the range belong to the next leaf or to the padding
+                if (end - i < static_cast<size_t>(laneCount)) {
+                    mask &= (1 << (end - i)) - 1;
+                }
+
+                for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+                    if ((mask & 1) && HitExact(i + lane, r, tMin, tMax, rec)) {
+                        hitAnything = true;
+                        tMax = rec.t;
+                    }
+                }
+            }
+#else
+            for (size_t i = first; i < end; i++) {
+                if (HitExact(i, r, tMin, tMax, rec)) {
+                    hitAnything = true;
+                    tMax = rec.t;
+                }
+            }
+#endif
+
+            return hitAnything;
+        }
+
+    private:
+        void Pad() {
+            size_t size = mCount + laneCount - 1;
+            mCenterX.resize(size, 0.0f);
+            mCenterY.resize(size, 0.0f);
+            mCenterZ.resize(size, 0.0f);
+            mRadius.resize(size, 0.0f);
+            if (Moving()) {
+                for (std::vector<float>* hot : { &mMotionX, &mMotionY, &mMotionZ }) {
+                    hot->resize(size, 0.0f);
+                }
+            }
+        }
+
+        bool HitExact(size_t i, const Ray& r, Real tMin, Real tMax, HitRecord& rec) const {
+            Vec3 center = Moving() ? Center(i) + r.time() * Motion(i) : Center(i);
+            return HitSphere(center, mExactRadius[i], mMaterials[i], r, tMin, tMax, rec);
+        }
+
+#if defined(SPHERE_BATCH_AVX)
+        // Bit i is set when sphere first + i may be hit in [tMinLoose, tMaxLoose]
+        int CandidateLanes(size_t first, const Vec3& origin, const Vec3& direction, float time, float a, float invA, float tMinLoose, float tMaxLoose) const {
+            __m256 cX = _mm256_loadu_ps(&mCenterX[first]);
+            __m256 cY = _mm256_loadu_ps(&mCenterY[first]);
+            __m256 cZ = _mm256_loadu_ps(&mCenterZ[first]);
+            if (Moving()) {
+                __m256 t = _mm256_set1_ps(time);
+                cX = _mm256_add_ps(cX, _mm256_mul_ps(t, _mm256_loadu_ps(&mMotionX[first])));
+                cY = _mm256_add_ps(cY, _mm256_mul_ps(t, _mm256_loadu_ps(&mMotionY[first])));
+                cZ = _mm256_add_ps(cZ, _mm256_mul_ps(t, _mm256_loadu_ps(&mMotionZ[first])));
+            }
+            __m256 ocX = _mm256_sub_ps(_mm256_set1_ps(origin.x()), cX);
+            __m256 ocY = _mm256_sub_ps(_mm256_set1_ps(origin.y()), cY);
+            __m256 ocZ = _mm256_sub_ps(_mm256_set1_ps(origin.z()), cZ);
+            __m256 radius = _mm256_loadu_ps(&mRadius[first]);
+            __m256 dX = _mm256_set1_ps(direction.x());
+            __m256 dY = _mm256_set1_ps(direction.y());
+            __m256 dZ = _mm256_set1_ps(direction.z());
+
+            __m256 halfB = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, dX), _mm256_mul_ps(ocY, dY)), _mm256_mul_ps(ocZ, dZ));
+            __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, ocX), _mm256_mul_ps(ocY, ocY)), _mm256_mul_ps(ocZ, ocZ)), _mm256_mul_ps(radius, radius));
+            __m256 halfB2 = _mm256_mul_ps(halfB, halfB);
+            __m256 ac = _mm256_mul_ps(_mm256_set1_ps(a), c);
+            __m256 delta = _mm256_sub_ps(halfB2, ac);
+
+            // delta suffers from cancellation, accept slightly negative values
+            __m256 absAc = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), ac);
+            __m256 tolerance = _mm256_mul_ps(_mm256_set1_ps(1e-5f), _mm256_add_ps(halfB2, absAc));
+            __m256 crosses = _mm256_cmp_ps(_mm256_add_ps(delta, tolerance), _mm256_setzero_ps(), _CMP_GE_OQ);
+
+            __m256 sqrtDelta = _mm256_sqrt_ps(_mm256_max_ps(delta, _mm256_setzero_ps()));
+            __m256 invAV = _mm256_set1_ps(invA);
+            __m256 tNear = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtDelta), invAV);
+            __m256 tFar = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtDelta), invAV);
+
+            // One of the roots lies in the interval when [tNear, tFar] overlaps it
+            __m256 inRange = _mm256_and_ps(_mm256_cmp_ps(tFar, _mm256_set1_ps(tMinLoose), _CMP_GE_OQ), _mm256_cmp_ps(tNear, _mm256_set1_ps(tMaxLoose), _CMP_LE_OQ));
+
+            return _mm256_movemask_ps(_mm256_and_ps(crosses, inRange));
+        }
+#elif defined(SPHERE_BATCH_SSE)
+        // Bit i is set when sphere first + i may be hit in [tMinLoose, tMaxLoose]
+        int CandidateLanes(size_t first, const Vec3& origin, const Vec3& direction, float time, float a, float invA, float tMinLoose, float tMaxLoose) const {
+            __m128 cX = _mm_loadu_ps(&mCenterX[first]);
+            __m128 cY = _mm_loadu_ps(&mCenterY[first]);
+            __m128 cZ = _mm_loadu_ps(&mCenterZ[first]);
+            if (Moving()) {
+                __m128 t = _mm_set1_ps(time);
+                cX = _mm_add_ps(cX, _mm_mul_ps(t, _mm_loadu_ps(&mMotionX[first])));
+                cY = _mm_add_ps(cY, _mm_mul_ps(t, _mm_loadu_ps(&mMotionY[first])));
+                cZ = _mm_add_ps(cZ, _mm_mul_ps(t, _mm_loadu_ps(&mMotionZ[first])));
+            }
+            __m128 ocX = _mm_sub_ps(_mm_set1_ps(origin.x()), cX);
+            __m128 ocY = _mm_sub_ps(_mm_set1_ps(origin.y()), cY);
+            __m128 ocZ = _mm_sub_ps(_mm_set1_ps(origin.z()), cZ);
+            __m128 radius = _mm_loadu_ps(&mRadius[first]);
+            __m128 dX = _mm_set1_ps(direction.x());
+            __m128 dY = _mm_set1_ps(direction.y());
+            __m128 dZ = _mm_set1_ps(direction.z());
+
+            __m128 halfB = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, dX), _mm_mul_ps(ocY, dY)), _mm_mul_ps(ocZ, dZ));
+            __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), _mm_mul_ps(radius, radius));
+            __m128 halfB2 = _mm_mul_ps(halfB, halfB);
+            __m128 ac = _mm_mul_ps(_mm_set1_ps(a), c);
+            __m128 delta = _mm_sub_ps(halfB2, ac);
+
+            // delta suffers from cancellation, accept slightly negative values
+            __m128 absAc = _mm_andnot_ps(_mm_set1_ps(-0.0f), ac);
+            __m128 tolerance = _mm_mul_ps(_mm_set1_ps(1e-5f), _mm_add_ps(halfB2, absAc));
+            __m128 crosses = _mm_cmpge_ps(_mm_add_ps(delta, tolerance), _mm_setzero_ps());
+
+            __m128 sqrtDelta = _mm_sqrt_ps(_mm_max_ps(delta, _mm_setzero_ps()));
+            __m128 invAV = _mm_set1_ps(invA);
+            __m128 tNear = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), halfB), sqrtDelta), invAV);
+            __m128 tFar = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_setzero_ps(), halfB), sqrtDelta), invAV);
+
+            // One of the roots lies in the interval when [tNear, tFar] overlaps it
+            __m128 inRange = _mm_and_ps(_mm_cmpge_ps(tFar, _mm_set1_ps(tMinLoose)), _mm_cmple_ps(tNear, _mm_set1_ps(tMaxLoose)));
+
+            return _mm_movemask_ps(_mm_and_ps(crosses, inRange));
+        }
+#endif
+};
+
+// FlatBvh whose leaves are read from a SphereBatch, for scenes made of spheres only
+using SphereBvh = FlatBvhT<SphereBatch>;
+
+#endif //SPHERE_BATCH_H
@@ -0,0 +1,88 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads started once and reused by every render, the calling thread counts as one of them
+class ThreadPool {
+    private:
+        std::vector<std::thread> mThreads;
+        std::mutex mMutex;
+        std::condition_variable mWake;
+        std::condition_variable mDone;
+        std::function<void()> mTask;
+        // Bumped for every Run(), tells the workers a new task is there
+        uint64_t mGeneration = 0;
+        int mBusy = 0;
+        bool mStop = false;
+
+    public:
+        explicit ThreadPool(int threadCount) {
+            for (int i = 1; i < threadCount; i++) {
+                mThreads.emplace_back([this]() { WorkerLoop(); });
+            }
+        }
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStop = true;
+            }
+            mWake.notify_all();
+            for (std::thread& thread : mThreads) {
+                thread.join();
+            }
+        }
+
+        int ThreadCount() const { return static_cast<int>(mThreads.size()) + 1; }
+
+        // Runs task once on every thread of the pool and returns when all of them are done
+        void Run(const std::function<void()>& task) {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mTask = task;
+                mBusy = static_cast<int>(mThreads.size());
+                mGeneration++;
+            }
+            mWake.notify_all();
+
+            task();
+
+            std::unique_lock<std::mutex> lock(mMutex);
+            mDone.wait(lock, [this]() { return mBusy == 0; });
+            mTask = nullptr;
+        }
+
+    private:
+        void WorkerLoop() {
+            uint64_t seen = 0;
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(mMutex);
+                    mWake.wait(lock, [&]() { return mStop || mGeneration != seen; });
+                    if (mStop) {
+                        return;
+                    }
+                    seen = mGeneration;
+                    task = mTask;
+                }
+
+                task();
+
+                std::lock_guard<std::mutex> lock(mMutex);
+                if (--mBusy == 0) {
+                    mDone.notify_one();
+                }
+            }
+        }
+};
+
+#endif //THREAD_POOL_H
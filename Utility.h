@@ -5,11 +5,21 @@
 #include <limits>
 #include <memory>
 #include <cstdlib>
+#include <cstdint>
+
+#include "Random.h"
 
 using std::shared_ptr;
 using std::make_shared;
 using std::sqrt;
 
+// Scalar of the whole pipeline (vectors, rays, hits, materials, camera): float for throughput, double for precision
+#ifdef RAYTRACER_DOUBLE
+typedef double Real;
+#else
+typedef float Real;
+#endif
+
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
 
@@ -19,7 +29,7 @@ inline double DegreesToRadians(double degrees) {
 
 inline double RandomDouble() {
     // Returns a random real in [0, 1[
-    return rand() / (RAND_MAX + 1.0);
+    return RandomGenerator().NextDouble();
 }
 
 inline double RandomDouble(double min, double max) {
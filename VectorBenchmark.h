@@ -0,0 +1,75 @@
+#ifndef VECTOR_BENCHMARK_H
+#define VECTOR_BENCHMARK_H
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Sampling.h"
+#include "Vec3.h"
+
+struct VectorOpTiming {
+    std::string name;
+    double nanoseconds;
+};
+
+// Nanoseconds per operation of the vector math of the hot paths, on arrays small enough to stay in L1
+// Results are summed into a checksum so the compiler can't drop the loops
+std::vector<VectorOpTiming> RunVectorBenchmark(int repeats = 4000) {
+    const size_t count = 1024;
+    std::vector<Vec3> a(count), b(count), out(count);
+    SeedRandom(7, 0);
+    for (size_t i = 0; i < count; i++) {
+        a[i] = unitVector(Vec3::Random(-1.0, 1.0));
+        b[i] = unitVector(Vec3::Random(-1.0, 1.0));
+    }
+
+    Real checksum = 0;
+    std::vector<VectorOpTiming> timings;
+    auto time = [&](const char* name, const std::function<void()>& loop) {
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < repeats; r++) {
+            loop();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        timings.push_back({ name, seconds * 1e9 / (double(repeats) * count) });
+        checksum += out[count / 2].x();
+    };
+
+    // std::function keeps every loop out of line, as the vector ops are in the renderer's hot functions
+    time("add-scale", [&]() { for (size_t i = 0; i < count; i++) out[i] = a[i] + Real(0.5) * b[i]; });
+    time("dot", [&]() { for (size_t i = 0; i < count; i++) out[i][0] = dot(a[i], b[i]); });
+    time("cross", [&]() { for (size_t i = 0; i < count; i++) out[i] = cross(a[i], b[i]); });
+    time("normalize", [&]() { for (size_t i = 0; i < count; i++) out[i] = unitVector(a[i] + b[i]); });
+    time("reflect", [&]() { for (size_t i = 0; i < count; i++) out[i] = Reflect(a[i], b[i]); });
+    time("refract", [&]() { for (size_t i = 0; i < count; i++) out[i] = Refract(a[i], b[i], Real(1.0 / 1.5)); });
+
+    // Sample mappings: one at a time, then the structure of arrays batch over the same numbers
+    std::vector<float> u1(count), u2(count), x(count), y(count), z(count);
+    for (size_t i = 0; i < count; i++) {
+        u1[i] = float(RandomDouble());
+        u2[i] = float(RandomDouble());
+    }
+    time("cosine", [&]() { for (size_t i = 0; i < count; i++) out[i] = CosineHemisphere(a[i], u1[i], u2[i]); });
+    time("cosine-batch", [&]() {
+        CosineHemisphereBatch(u1.data(), u2.data(), x.data(), y.data(), z.data(), count);
+        out[count / 2][0] = x[count / 2];
+    });
+
+    if (checksum == Real(12345.678)) {
+        std::cerr << checksum;
+    }
+    return timings;
+}
+
+void PrintVectorBenchmark(std::ostream& out, const std::vector<VectorOpTiming>& timings) {
+    out << "Vector ops (" << sizeof(Vec3) << " byte Vec3):";
+    for (const VectorOpTiming& timing : timings) {
+        out << " " << timing.name << " " << timing.nanoseconds << " ns";
+    }
+    out << "\n";
+}
+
+#endif //VECTOR_BENCHMARK_H
@@ -0,0 +1,215 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "Utility.h"
+#include "Hittable.h"
+#include "Material.h"
+#include "Integrator.h"
+
+// One path of the wavefront, carries everything TracePath() keeps on its stack
+struct PathState {
+    Ray ray;
+    Vec3 throughput;
+    // Light gathered so far, the final color once the path is terminated
+    Vec3 color;
+    // Density of the bounce that chose ray, see EmittedLight()
+    Real bsdfPdf;
+    // Random state of the path, swapped in while the path scatters so it draws the same numbers as with TracePath()
+    RandomEngine engine;
+    int depth;
+};
+
+struct WavefrontStageStats {
+    uint64_t rays = 0;
+    double seconds = 0.0;
+};
+
+struct WavefrontStats {
+    enum Stage { Generate, Extend, Miss, ShadeLambertian, ShadeMetal, ShadeDielectric, ShadeLight, ShadeOther, StageCount };
+
+    WavefrontStageStats stages[StageCount];
+
+    void Merge(const WavefrontStats& other) {
+        for (int i = 0; i < StageCount; i++) {
+            stages[i].rays += other.stages[i].rays;
+            stages[i].seconds += other.stages[i].seconds;
+        }
+    }
+
+    static const char* StageName(int stage) {
+        static const char* names[StageCount] = { "generate", "extend", "miss", "shade lambertian", "shade metal", "shade dielectric", "shade light", "shade other" };
+        return names[stage];
+    }
+};
+
+// Traces a batch of paths stage by stage: all intersections, then the misses, then the scattering grouped by material
+// so each material runs in its own tight loop with direct (non virtual) Scatter calls
+class WavefrontIntegrator {
+    private:
+        const Hittable& mWorld;
+        PathSettings mPaths;
+        // Reused between calls, sized after the largest batch
+        std::vector<HitRecord> mHits;
+        std::vector<uint32_t> mActive;
+        std::vector<uint32_t> mQueues[5];
+        const LightList* mLights;
+
+    public:
+        WavefrontIntegrator(const Hittable& world, const PathSettings& paths)
+            : mWorld(world), mPaths(paths), mLights(paths.lights && !paths.lights->Empty() ? paths.lights : nullptr) {}
+
+        // Runs until every path is terminated, paths keep their order and their color is set
+        void Trace(std::vector<PathState>& paths, WavefrontStats& stats, PathCounters& counters) {
+            counters.paths += paths.size();
+
+            mHits.resize(paths.size());
+            mActive.clear();
+            for (uint32_t i = 0; i < paths.size(); i++) {
+                mActive.push_back(i);
+            }
+
+            while (!mActive.empty()) {
+                counters.segments += mActive.size();
+                Extend(paths, stats);
+                SortHits(paths, stats);
+
+                mActive.clear();
+                ShadeQueue(paths, mQueues[static_cast<int>(MaterialKind::Lambertian)], stats.stages[WavefrontStats::ShadeLambertian], counters,
+                    [](const Material* mat, const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) {
+                        return static_cast<const Lambertian*>(mat)->Lambertian::Scatter(rIn, rec, attenuation, scattered);
+                    });
+                ShadeQueue(paths, mQueues[static_cast<int>(MaterialKind::Metal)], stats.stages[WavefrontStats::ShadeMetal], counters,
+                    [](const Material* mat, const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) {
+                        return static_cast<const Metal*>(mat)->Metal::Scatter(rIn, rec, attenuation, scattered);
+                    });
+                ShadeQueue(paths, mQueues[static_cast<int>(MaterialKind::Dielectric)], stats.stages[WavefrontStats::ShadeDielectric], counters,
+                    [](const Material* mat, const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) {
+                        return static_cast<const Dielectric*>(mat)->Dielectric::Scatter(rIn, rec, attenuation, scattered);
+                    });
+                ShadeQueue(paths, mQueues[static_cast<int>(MaterialKind::DiffuseLight)], stats.stages[WavefrontStats::ShadeLight], counters,
+                    [](const Material* mat, const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) {
+                        return static_cast<const DiffuseLight*>(mat)->DiffuseLight::Scatter(rIn, rec, attenuation, scattered);
+                    });
+                ShadeQueue(paths, mQueues[static_cast<int>(MaterialKind::Other)], stats.stages[WavefrontStats::ShadeOther], counters,
+                    [](const Material* mat, const Ray& rIn, const HitRecord& rec, Vec3& attenuation, Ray& scattered) {
+                        return mat->Scatter(rIn, rec, attenuation, scattered);
+                    });
+            }
+        }
+
+    private:
+        void Extend(std::vector<PathState>& paths, WavefrontStats& stats) {
+            auto start = std::chrono::steady_clock::now();
+
+            for (uint32_t i : mActive) {
+                // A hit record with no material marks a miss
+                mHits[i].materialPtr = nullptr;
+                HitRecord rec;
+                if (mWorld.Hit(paths[i].ray, 0.001, infinity, rec)) {
+                    mHits[i] = rec;
+                }
+            }
+
+            WavefrontStageStats& stage = stats.stages[WavefrontStats::Extend];
+            stage.rays += mActive.size();
+            stage.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Terminates the paths that missed, adds the light of the emitters hit and queues the paths by material
+        void SortHits(std::vector<PathState>& paths, WavefrontStats& stats) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t misses = 0;
+
+            for (std::vector<uint32_t>& queue : mQueues) {
+                queue.clear();
+            }
+
+            for (uint32_t i : mActive) {
+                const Material* mat = mHits[i].materialPtr;
+                if (!mat) {
+                    paths[i].color += paths[i].throughput * (mPaths.skyIntensity * SkyColor(paths[i].ray));
+                    misses++;
+                    continue;
+                }
+                paths[i].color += paths[i].throughput * EmittedLight(paths[i].ray, mHits[i], paths[i].bsdfPdf, mLights);
+                mQueues[static_cast<int>(mat->mKind)].push_back(i);
+            }
+
+            WavefrontStageStats& stage = stats.stages[WavefrontStats::Miss];
+            stage.rays += misses;
+            stage.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        // Scatters every path of the queue with scatter, paths with bounces left go back to mActive
+        template <typename ScatterFunction>
+        void ShadeQueue(std::vector<PathState>& paths, const std::vector<uint32_t>& queue, WavefrontStageStats& stage, PathCounters& counters, ScatterFunction scatter) {
+            if (queue.empty()) {
+                return;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            RandomEngine& generator = RandomGenerator();
+
+            for (uint32_t i : queue) {
+                PathState& path = paths[i];
+                const HitRecord& rec = mHits[i];
+
+                generator = path.engine;
+
+                // Shadow rays are traced here rather than in a stage of their own, so the path draws its numbers in
+                // the same order as with TracePath()
+                bool sampleLights = mLights && rec.materialPtr->mKind == MaterialKind::Lambertian;
+                if (sampleLights) {
+                    path.color += path.throughput * SampleDirectLight(mWorld, *mLights, path.ray, rec, static_cast<const Lambertian*>(rec.materialPtr)->mAlbedo, counters);
+                }
+
+                Ray scattered;
+                Vec3 attenuation;
+                bool scatters = scatter(rec.materialPtr, path.ray, rec, attenuation, scattered);
+                bool killed = false;
+                if (scatters) {
+                    path.throughput *= attenuation;
+                    path.bsdfPdf = sampleLights ? std::fmax(Real(0), dot(scattered.direction(), rec.normal)) / Real(pi) : 0;
+                    path.ray = scattered;
+
+                    int bounce = mPaths.maxDepth - path.depth;
+                    killed = mPaths.rouletteMinDepth >= 0 && bounce + 1 >= mPaths.rouletteMinDepth && !SurviveRoulette(path.throughput);
+                    if (killed) {
+                        counters.rouletteKills++;
+                    }
+                }
+
+                path.engine = generator;
+
+                // If we've exceed the ray bounce limit, no more light is gathered
+                if (--path.depth > 0 && scatters && !killed) {
+                    mActive.push_back(i);
+                }
+            }
+
+            stage.rays += queue.size();
+            stage.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+};
+
+void PrintWavefrontReport(std::ostream& out, const WavefrontStats& stats) {
+    out << "Wavefront stages:\n";
+    for (int i = 0; i < WavefrontStats::StageCount; i++) {
+        const WavefrontStageStats& stage = stats.stages[i];
+        if (stage.rays == 0) {
+            continue;
+        }
+        out << "  " << WavefrontStats::StageName(i) << ": " << stage.rays << " rays, " << stage.seconds << " s";
+        if (stage.seconds > 0.0) {
+            out << ", " << stage.rays / stage.seconds / 1e6 << " Mrays/s";
+        }
+        out << '\n';
+    }
+}
+
+#endif //WAVEFRONT_H
@@ -0,0 +1,315 @@
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "CommandLine.h"
+#include "ExampleScenes.h"
+#include "FlatBvh.h"
+#include "ImageDiff.h"
+#include "ImageWriter.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "SceneFile.h"
+#include "SphereBatch.h"
+#include "VectorBenchmark.h"
+
+#ifndef RAYTRACER_BUILD_TYPE
+#define RAYTRACER_BUILD_TYPE ""
+#endif
+
+using namespace std;
+
+// Canonical scenes, rendered with the same settings by every build so the numbers can be compared over time
+struct BenchScene {
+    std::string name;
+    // Sphere count given to RandomSpheresDescription, 0 for the scenes built in code
+    size_t sphereCount;
+    std::function<Scene()> build;
+};
+
+struct BenchPhase {
+    std::string name;
+    double milliseconds;
+};
+
+struct BenchResult {
+    std::string scene;
+    size_t primitives = 0;
+    size_t bvhNodes = 0;
+    size_t bvhBytes = 0;
+    int threads = 0;
+    double primaryRaysPerSecond = 0.0;
+    double primaryPacketRaysPerSecond = 0.0;
+    double raysPerSecond = 0.0;
+    double samplesPerSecond = 0.0;
+    uint64_t rays = 0;
+    double nodesPerRay = 0.0;
+    double primitivesPerRay = 0.0;
+    std::vector<BenchPhase> phases;
+    // Against the same scene rendered by another build (--reference)
+    ImageDifference difference;
+};
+
+// Where the renders go and what they are compared to, both empty by default
+struct BenchImages {
+    std::string directory;
+    std::string referenceDirectory;
+};
+
+static double MillisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+BenchResult RunBenchScene(const BenchScene& benchScene, const RenderJob& job, const BenchImages& images) {
+    BenchResult result;
+    result.scene = benchScene.name;
+
+    // Scene, then its acceleration structure
+    auto start = chrono::steady_clock::now();
+    Scene scene;
+    SceneDescription description;
+    Arena materials;
+    SphereBatch batch;
+    SeedRandom(job.settings.seed, 1);
+    if (benchScene.sphereCount > 0) {
+        description = RandomSpheresDescription(benchScene.sphereCount);
+        batch = BuildSphereBatch(description, MakeMaterials(description, materials));
+    }
+    else {
+        scene = benchScene.build();
+    }
+    result.phases.push_back({ "scene", MillisecondsSince(start) });
+
+    start = chrono::steady_clock::now();
+    SphereBvh bvh = benchScene.sphereCount > 0 ? SphereBvh(batch) : SphereBvh(scene.World());
+    result.phases.push_back({ "bvh", MillisecondsSince(start) });
+    result.primitives = bvh.PrimitiveCount();
+    result.bvhNodes = bvh.NodeCount();
+    result.bvhBytes = bvh.MemoryFootprint();
+
+    TileRenderer renderer(job.settings);
+    Camera cam = job.MakeCamera();
+    result.threads = renderer.ThreadCount();
+
+    // Primary hits only, one ray per pixel on one thread
+    start = chrono::steady_clock::now();
+    result.primaryRaysPerSecond = renderer.PrimaryRayRate(bvh, cam, false);
+    result.primaryPacketRaysPerSecond = renderer.PrimaryRayRate(bvh, cam, true);
+    result.phases.push_back({ "primary", MillisecondsSince(start) });
+
+    // Whole paths on every thread, traversal counters only hold the render
+    Framebuffer framebuffer(job.settings.imageWidth, job.settings.imageHeight);
+    BvhTraversalRegistry::Instance().Reset();
+    ResetProfile();
+    start = chrono::steady_clock::now();
+    renderer.Render(bvh, cam, framebuffer);
+    double renderMs = MillisecondsSince(start);
+    result.phases.push_back({ "render", renderMs });
+
+    const PathCounters& paths = renderer.LastPathCounters();
+    BvhTraversalCounters traversal = BvhTraversalRegistry::Instance().Total();
+    result.rays = paths.segments;
+    result.raysPerSecond = paths.segments / (renderMs / 1000.0);
+    result.samplesPerSecond = paths.paths / (renderMs / 1000.0);
+    if (traversal.rays > 0) {
+        result.nodesPerRay = double(traversal.nodesVisited) / traversal.rays;
+        result.primitivesPerRay = double(traversal.primitivesTested) / traversal.rays;
+    }
+
+    // PFM keeps the linear values, so the comparison sees the precision of the render and not the quantization
+    std::string imageName = "/" + benchScene.name + ".pfm";
+    if (!images.directory.empty()) {
+        WriteImage(images.directory + imageName, framebuffer);
+    }
+    if (!images.referenceDirectory.empty()) {
+        FloatImage image;
+        FloatImage reference;
+        if (!images.directory.empty() && ReadPfm(images.directory + imageName, image) && ReadPfm(images.referenceDirectory + imageName, reference)) {
+            result.difference = CompareImages(image, reference);
+        }
+    }
+
+    return result;
+}
+
+void PrintBenchResult(std::ostream& out, const BenchResult& result) {
+    out << "\r" << result.scene << ": " << result.primitives << " primitives | primary " << result.primaryRaysPerSecond / 1e6
+        << " Mrays/s (" << result.primaryPacketRaysPerSecond / 1e6 << " packets) | total " << result.raysPerSecond / 1e6
+        << " Mrays/s | " << result.nodesPerRay << " nodes + " << result.primitivesPerRay << " primitives per ray\n  ";
+    for (const BenchPhase& phase : result.phases) {
+        out << phase.name << " " << phase.milliseconds << " ms  ";
+    }
+    out << "\n";
+    if (result.difference.valid) {
+        out << "  against the reference: ";
+        PrintImageDifference(out, result.difference);
+    }
+}
+
+// Everything a later run needs to tell whether it is comparable: build, settings, then one entry per scene
+void WriteBenchJson(std::ostream& out, const RenderJob& job, const std::vector<BenchResult>& results, const std::vector<VectorOpTiming>& vectorOps) {
+    const RenderSettings& s = job.settings;
+    int threadCount = results.empty() ? 0 : results.front().threads;
+    std::streamsize precision = out.precision(10);
+    out << "{\n";
+    out << "  \"build\": { \"type\": \"" << RAYTRACER_BUILD_TYPE << "\", \"compiler\": \"" <<
+#if defined(__clang__)
+        "clang " << __clang_major__ << "." << __clang_minor__
+#elif defined(__GNUC__)
+        "gcc " << __GNUC__ << "." << __GNUC_MINOR__
+#elif defined(_MSC_VER)
+        "msvc " << _MSC_VER
+#else
+        "unknown"
+#endif
+        << "\", \"rng\": \""
+#ifdef RAYTRACER_RNG_XOSHIRO
+        << "xoshiro256+"
+#else
+        << "pcg32"
+#endif
+        << "\", \"precision\": \"" << (sizeof(Real) == sizeof(double) ? "double" : "float")
+        << "\", \"vec3Bytes\": " << sizeof(Vec3) << ", \"simd\": \""
+#ifdef __AVX2__
+        << "avx2"
+#else
+        << "sse2"
+#endif
+        << "\" },\n";
+    out << "  \"settings\": { \"width\": " << s.imageWidth << ", \"height\": " << s.imageHeight << ", \"samplesPerPixel\": " << s.samplesPerPixel
+        << ", \"maxDepth\": " << s.maxDepth << ", \"rouletteMinDepth\": " << s.rouletteMinDepth << ", \"threads\": " << threadCount
+        << ", \"packets\": " << (s.usePackets ? "true" : "false") << ", \"integrator\": \""
+        << (s.integrator == IntegratorMode::Wavefront ? "wavefront" : "iterative") << "\", \"seed\": " << s.seed << " },\n";
+    if (!vectorOps.empty()) {
+        out << "  \"vectorOpsNs\": {";
+        for (size_t i = 0; i < vectorOps.size(); i++) {
+            out << (i > 0 ? ", " : " ") << "\"" << vectorOps[i].name << "\": " << vectorOps[i].nanoseconds;
+        }
+        out << " },\n";
+    }
+    out << "  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    { \"name\": \"" << r.scene << "\", \"primitives\": " << r.primitives << ", \"bvhNodes\": " << r.bvhNodes
+            << ", \"bvhBytes\": " << r.bvhBytes << ",\n";
+        out << "      \"primaryRaysPerSecond\": " << r.primaryRaysPerSecond << ", \"primaryPacketRaysPerSecond\": " << r.primaryPacketRaysPerSecond
+            << ", \"raysPerSecond\": " << r.raysPerSecond << ", \"samplesPerSecond\": " << r.samplesPerSecond << ", \"rays\": " << r.rays << ",\n";
+        out << "      \"nodesPerRay\": " << r.nodesPerRay << ", \"primitivesPerRay\": " << r.primitivesPerRay
+            << ", \"testsPerRay\": " << r.nodesPerRay + r.primitivesPerRay << ",\n";
+        out << "      \"phasesMs\": {";
+        for (size_t p = 0; p < r.phases.size(); p++) {
+            out << (p > 0 ? ", " : " ") << "\"" << r.phases[p].name << "\": " << r.phases[p].milliseconds;
+        }
+        out << " }";
+        if (r.difference.valid) {
+            const ImageDifference& d = r.difference;
+            out << ",\n      \"reference\": { \"rmse\": " << d.rmse << ", \"meanAbsolute\": " << d.meanAbsolute << ", \"maxAbsolute\": " << d.maxAbsolute
+                << ", \"psnr\": " << (std::isinf(d.psnr) ? 999.0 : d.psnr) << ", \"visiblePixelsPercent\": " << d.visiblePixelsPercent << " }";
+        }
+        out << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    out.precision(precision);
+}
+
+void PrintBenchUsage(std::ostream& out) {
+    out << "Usage: Raytracer_bench [options] [job options]\n"
+        << "  --json <file>     results as JSON (- for stdout, the default)\n"
+        << "  --only <names>    comma separated scenes among three-spheres,random,spheres-10k,spheres-100k,spheres-1m\n"
+        << "  --skip-1m         leave out the million sphere scene\n"
+        << "  --vector-ops      time the vector math (add, dot, cross, normalize, reflect, refract) first\n"
+        << "  --images <dir>    write every render as <dir>/<scene>.pfm\n"
+        << "  --reference <dir> compare the renders to the ones of another run (another build), needs --images\n"
+        << "Job options are the ones of Raytracer (--width, --spp, --threads, --integrator...).\n";
+}
+
+int main(int argc, char** argv) {
+    // Small enough for the big scenes to finish in seconds, adaptive sampling off so every run does the same work
+    RenderJob job;
+    job.settings.imageWidth = 240;
+    job.settings.imageHeight = 160;
+    job.settings.samplesPerPixel = 8;
+    job.camera = { { 13.0, 2.0, 3.0 }, { 0.0, 0.0, 0.0 }, { 0.0, 1.0, 0.0 }, 20.0, 0.1, 10.0, 0.0 };
+
+    std::string jsonPath = "-";
+    std::string only;
+    bool skipMillion = false;
+    BenchImages images;
+    bool vectorOps = false;
+    std::vector<std::string> jobArguments;
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--help" || option == "-h") {
+            PrintBenchUsage(std::cout);
+            return 0;
+        }
+        else if ((option == "--json" || option == "--only") && i + 1 < argc) {
+            (option == "--json" ? jsonPath : only) = argv[++i];
+        }
+        else if ((option == "--images" || option == "--reference") && i + 1 < argc) {
+            (option == "--images" ? images.directory : images.referenceDirectory) = argv[++i];
+        }
+        else if (option == "--vector-ops") {
+            vectorOps = true;
+        }
+        else if (option == "--skip-1m") {
+            skipMillion = true;
+        }
+        else {
+            jobArguments.push_back(option);
+        }
+    }
+
+    std::string error;
+    if (!ParseJobOptions(jobArguments, job, error)) {
+        std::cerr << error << "\n";
+        PrintBenchUsage(std::cerr);
+        return 1;
+    }
+
+    std::vector<BenchScene> scenes = {
+        { "three-spheres", 0, ThreeSpheresScene },
+        { "random", 0, RandomScene },
+        { "spheres-10k", 10000, nullptr },
+        { "spheres-100k", 100000, nullptr },
+        { "spheres-1m", 1000000, nullptr },
+    };
+
+    std::vector<VectorOpTiming> vectorTimings;
+    if (vectorOps) {
+        vectorTimings = RunVectorBenchmark();
+        PrintVectorBenchmark(std::cerr, vectorTimings);
+    }
+
+    std::vector<BenchResult> results;
+    for (const BenchScene& scene : scenes) {
+        if (!only.empty() && ("," + only + ",").find("," + scene.name + ",") == std::string::npos) {
+            continue;
+        }
+        if (skipMillion && scene.sphereCount >= 1000000) {
+            continue;
+        }
+
+        results.push_back(RunBenchScene(scene, job, images));
+        PrintBenchResult(std::cerr, results.back());
+        PrintProfileReport(std::cerr);
+    }
+
+    if (jsonPath == "-") {
+        WriteBenchJson(std::cout, job, results, vectorTimings);
+    }
+    else {
+        std::ofstream json(jsonPath);
+        WriteBenchJson(json, job, results, vectorTimings);
+        if (!json) {
+            std::cerr << "Can't write " << jsonPath << ".\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
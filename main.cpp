@@ -1,99 +1,52 @@
 #include <iostream>
 #include <fstream>
+#include <chrono>
+#include <memory>
 
 #include "Camera.h"
 #include "Color.h"
 #include "HittableList.h"
 #include "Sphere.h"
 #include "Material.h"
+#include "Renderer.h"
+#include "SphereBatch.h"
+#include "Scene.h"
+#include "HandleBenchmark.h"
+#include "ImageWriter.h"
+#include "Progressive.h"
+#include "SceneFile.h"
+#include "CommandLine.h"
+#include "DenoiseBenchmark.h"
+#include "InstanceBenchmark.h"
+#include "LightBenchmark.h"
+#include "ExampleScenes.h"
+#include "Animation.h"
+#include "Light.h"
+#include "Distributed.h"
 
 using namespace std;
 
-HittableList RandomScene() {
-    HittableList world;
-
-    shared_ptr<Lambertian> groundMaterial = make_shared<Lambertian>(Vec3(0.5, 0.5, 0.5));
-    world.Add(make_shared<Sphere>(Vec3(0.0, -1000, 0.0), 1000.0, groundMaterial));
-
-    for (int i = -11; i < 11; i++)
-    {
-        for (int j = -11; j < 11; j++)
-        {
-            double chooseMat = RandomDouble();
-            Vec3 center(i + 0.9*RandomDouble(), 0.2, j + 0.9*RandomDouble());
-
-            if ((center - Vec3(4.0, 0.2, 0.0)).length() > 0.9) {
-                shared_ptr<Material> sphereMaterial;
-
-                if (chooseMat < 0.8) {
-                    // Diffuse 
-                    Vec3 albedo = Vec3::Random() * Vec3::Random();
-                    sphereMaterial = make_shared<Lambertian>(albedo);
-                    world.Add(make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
-                else if (chooseMat < 0.95) {
-                    // Metal
-                    Vec3 albedo = Vec3::Random(0.5, 1.0);
-                    double fuzzyness = RandomDouble(0.0, 0.5);
-                    sphereMaterial = make_shared<Metal>(albedo, fuzzyness);
-                     world.Add(make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
-                else {
-                    // Glass
-                    sphereMaterial = make_shared<Dielectric>(1.5);
-                    world.Add(make_shared<Sphere>(center, 0.2, sphereMaterial));
-                }
-            }
-        }
-    }
-    
-    shared_ptr<Dielectric> dielectricExampleMaterial = make_shared<Dielectric>(1.5);
-    world.Add(make_shared<Sphere>(Vec3(0.0, 1.0, 0.0), 1.0, dielectricExampleMaterial));
-    shared_ptr<Lambertian> lambertianExampleMaterial = make_shared<Lambertian>(Vec3(0.4, 0.2, 0.1));
-    world.Add(make_shared<Sphere>(Vec3(-4.0, 1.0, 0.0), 1.0, lambertianExampleMaterial));
-    shared_ptr<Metal> metalExampleMaterial = make_shared<Metal>(Vec3(0.7, 0.6, 0.5), 0.0);
-    world.Add(make_shared<Sphere>(Vec3(4.0, 1.0, 0.0), 1.0, metalExampleMaterial));
-
-    return world;
-}
-
-Vec3 RayColor(const Ray& r, const Hittable& world, int depth) {
-    HitRecord rec;
-
-    // If we've exceed the ray bounce limit, no more light is gathered
-    if (depth <= 0) {
-        return Vec3(0,0,0);
+int main(int argc, char** argv){
+    // Init ================================================
+    BatchOptions options;
+    std::string error;
+    if (!ParseCommandLine(argc, argv, options, error)) {
+        std::cerr << error << "\n";
+        PrintUsage(std::cerr);
+        return 1;
     }
-    
-    if(world.Hit(r, 0.001, infinity, rec)) {
-        Ray scattered;
-        Vec3 attenuation;
-
-        if (rec.materialPtr->Scatter(r, rec, attenuation, scattered)) {
-            return attenuation * RayColor(scattered, world, depth-1);
-        }
-
-        Vec3 target = rec.p + rec.normal + RandomInHemisphere(rec.normal);
-        return 0.5 * RayColor(Ray(rec.p, target - rec.p), world, depth-1);
+    if (options.help) {
+        PrintUsage(std::cout);
+        return 0;
     }
 
-    // Display the sky
-    Vec3 unit_direction = unitVector(r.direction()); // -> unitVector : transformation en vecteur unitaire
-    double t = 0.5*(unit_direction.y() + 1.0);
-
-    return (1.0 - t)*Vec3(1.0, 1.0, 1.0) + t*Vec3(0.5, 0.7, 1.0);
-}
-
-int main(){
-    // Init ================================================
-    ofstream output;
-
-    // Image
+    // Image, defaults of every job: the scene file, the command line then the job list override them
     const auto aspectRatio = 3.0 / 2.0;
     const int imageWidth = 400;
     const int imageHeight = static_cast<int>(imageWidth / aspectRatio);
     const int samplesPerPixel = 500;
     const int maxDepth = 50;
+    const int tileSize = 16;
 
     // Vectors
     Vec3 lower_left_corner(-2.0, -1.0, -1.0);
@@ -102,42 +55,10 @@ int main(){
     Vec3 origin(0.0, 0.0, 0.0);
 
     // Objects
-    #pragma region PREVIOUS VERSION
-    /*
-    HittableList world;
-
-    shared_ptr<Lambertian> materialGround = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0));
-    shared_ptr<Lambertian> materialCenter = make_shared<Lambertian>(Vec3(0.7, 0.3, 0.3));
-    shared_ptr<Dieletric> materialLeft = make_shared<Dieletric>(1.5);
-    shared_ptr<Metal> materialRight = make_shared<Metal>(Vec3(0.8, 0.6, 0.2), 0.2);
-
-    world.Add(make_shared<Sphere>(Vec3(0.0, -100.5, -1.0), 100.0, materialGround));
-    world.Add(make_shared<Sphere>(Vec3(0.0, 0.0, -1.0), 0.5, materialCenter));
-    world.Add(make_shared<Sphere>(Vec3(-1.0, 0.0, -1.0), 0.5, materialLeft));
-    world.Add(make_shared<Sphere>(Vec3(-1.0, 0.0, -1.0), -0.4, materialLeft));
-    world.Add(make_shared<Sphere>(Vec3(1.0, 0.0, -1.0), 0.5, materialRight));
-    */
-    #pragma endregion
-    #pragma region MORE RECENT VERSION
-    
-    double radius = cos(pi/4);
-    HittableList world;
-
-    shared_ptr<Lambertian> materialGround = make_shared<Lambertian>(Vec3(0.8, 0.8, 0.0));
-    shared_ptr<Lambertian> materialCenter = make_shared<Lambertian>(Vec3(0.1, 0.2, 0.5));
-    shared_ptr<Dielectric> materialLeft = make_shared<Dielectric>(1.5);
-    shared_ptr<Metal> materialRight = make_shared<Metal>(Vec3(0.8, 0.6, 0.2), 0.0);
-
-    world.Add(make_shared<Sphere>(Vec3( 0.0, -100.5, -1.0), 100.0, materialGround));
-    world.Add(make_shared<Sphere>(Vec3( 0.0,    0.0, -1.0),   0.5, materialCenter));
-    world.Add(make_shared<Sphere>(Vec3(-1.0,    0.0, -1.0),   0.5, materialLeft));
-    world.Add(make_shared<Sphere>(Vec3(-1.0,    0.0, -1.0), -0.45, materialLeft));
-    world.Add(make_shared<Sphere>(Vec3( 1.0,    0.0, -1.0),   0.5, materialRight));
-    
-    #pragma endregion
+    Scene scene = ThreeSpheresScene();
 
     // Too long to render
-    // HittableList world = RandomScene();
+    // Scene scene = RandomScene();
 
     // Camera
     Vec3 lookFrom(13.0, 2.0, 3.0);
@@ -148,36 +69,266 @@ int main(){
     //double aperture = 2.0;
     double aperture = 0.1;
 
-    Camera cam(lookFrom, lookAt, vup, 20, aspectRatio, aperture, distToFocus);
+    RenderJob defaults;
+    defaults.camera = { { lookFrom.x(), lookFrom.y(), lookFrom.z() }, { lookAt.x(), lookAt.y(), lookAt.z() }, { vup.x(), vup.y(), vup.z() },
+                        20, aperture, distToFocus, aspectRatio };
 
     // =====================================================
 
-    output.open("output.ppm");
+    RenderSettings& settings = defaults.settings;
+    settings.imageWidth = imageWidth;
+    settings.imageHeight = imageHeight;
+    settings.samplesPerPixel = samplesPerPixel;
+    settings.maxDepth = maxDepth;
+    settings.tileSize = tileSize;
+
+    // The acceleration structure is built once and shared by every job
+    auto setupStart = chrono::steady_clock::now();
+    SphereBvh bvh;
+    SceneDescription description;
+    Arena fileMaterials;
+    if (!options.scenePath.empty()) {
+        if (!LoadScene(options.scenePath, description)) {
+            return 1;
+        }
+        // Spheres go straight from the file arrays into the BVH leaves
+        description.Apply(settings);
+        defaults.camera = description.camera;
+        bvh = SphereBvh(BuildSphereBatch(description, MakeMaterials(description, fileMaterials)));
+    }
+    else {
+        bvh = SphereBvh(scene.World());
+        if (bvh.PrimitiveCount() != scene.World().objects.size()) {
+            std::cerr << "The built-in scene must only hold spheres.\n";
+            return 1;
+        }
+    }
+    // Emitting spheres, sampled at every diffuse bounce
+    LightList lights(bvh.Leaves());
+    double setupSeconds = chrono::duration<double>(chrono::steady_clock::now() - setupStart).count();
+
+    RenderJob commandLineJob = defaults;
+    if (!ParseJobOptions(options.jobArguments, commandLineJob, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
 
-    // Write the size of the file
-    output << "P3\n" << imageWidth << " " << imageHeight << "\n255\n";
+    // Keyframes of the scene file, the command line overrides its frame count and shutter
+    SceneAnimation animation = SceneAnimation::FromDescription(description);
+    if (options.frames > 0) {
+        animation.frameCount = options.frames;
+    }
+    if (options.shutter >= 0.0) {
+        animation.shutter = options.shutter;
+    }
+    if (options.turntable) {
+        animation.AddTurntable(commandLineJob.camera, animation.frameCount);
+    }
+
+    std::vector<RenderJob> jobs;
+    if (options.jobsPath.empty()) {
+        // One job per frame, each with its own camera and numbered outputs
+        for (int f = 0; f < animation.frameCount; f++) {
+            RenderJob job = commandLineJob;
+            job.frame = f;
+            job.camera = animation.CameraAt(f, commandLineJob.camera);
+            job.cameraClose = animation.CameraAt(f + animation.shutter, commandLineJob.camera);
+            job.cameraMoves = animation.MovesCamera() && animation.shutter > 0.0;
+            if (animation.frameCount > 1) {
+                for (std::string* path : { &job.outputPath, &job.heatmapPath, &job.tileCostPath, &job.aovPrefix, &job.passes.checkpointPath, &job.passes.previewPath }) {
+                    if (!path->empty()) {
+                        *path = FramePath(*path, f);
+                    }
+                }
+            }
+            jobs.push_back(job);
+        }
+    }
+    else if (animation.frameCount > 1) {
+        std::cerr << "Animations (--frames) and job lists (--jobs) can't be combined.\n";
+        return 1;
+    }
+    else if (!ReadJobList(options.jobsPath, commandLineJob, jobs)) {
+        return 1;
+    }
+    // Every later step renders or reports on at least one job
+    if (jobs.empty()) {
+        std::cerr << "Nothing to render.\n";
+        return 1;
+    }
+    // Checkpoints are only resumed by the same scene, frame and camera
+    uint64_t sceneHash = description.Hash();
+    for (RenderJob& job : jobs) {
+        job.passes.sceneHash = job.SceneHash(sceneHash, animation.shutter);
+    }
+    bool reports = options.reports >= 0 ? options.reports != 0 : jobs.size() == 1;
+
+    // Moving spheres are updated in the leaves and the tree refit between frames instead of built again
+    std::unique_ptr<AnimatedSphereBvh> animatedBvh;
+    if (animation.MovesSpheres()) {
+        animatedBvh.reset(new AnimatedSphereBvh(bvh));
+    }
+    double frameSetupMilliseconds = 0.0;
+    double fullRebuildMilliseconds = 0.0;
 
     // Render ==============================================
-    for (int column = imageHeight-1; column>= 0; --column) {
-        // Progress bar
-        std::cerr << "\rScanlines remaining: " << column << " " << std::flush;
-
-        for (int row = 0; row < imageWidth; ++row) {
-            Vec3 color(0, 0, 0);
-            for(int s = 0; s < samplesPerPixel; s++) {
-                float u = float(row + RandomDouble()) / float(imageWidth - 1);
-                float v = float(column + RandomDouble()) / float(imageHeight - 1);
-                Ray r = cam.GetRay(u, v);
-                color += RayColor(r, world, maxDepth);
+    // One renderer for the whole batch, so its threads are only started once
+    TileRenderer renderer(jobs.front().settings);
+    renderer.SetLights(&lights);
+    BatchStats batch;
+
+    // Settings, scene and camera of job j, for the frames rendered here and for the workers
+    auto prepareJob = [&](size_t j, bool quiet) {
+        const RenderJob& job = jobs[j];
+        renderer.SetSettings(job.settings);
+        if (animatedBvh) {
+            // The first frame also times a full rebuild, every frame does with the reports
+            FrameSetupStats setup = animatedBvh->SetFrame(animation, job.frame, !quiet && (reports || j == 0));
+            frameSetupMilliseconds += setup.updateMilliseconds + setup.refitMilliseconds + setup.rebuildMilliseconds;
+            if (j == 0) {
+                fullRebuildMilliseconds = setup.fullRebuildMilliseconds;
+            }
+            if (!quiet) {
+                PrintFrameSetupReport(std::cerr, setup);
             }
-            WriteColor(output, color, samplesPerPixel);
+            // Emitting spheres may have moved too
+            lights = LightList(bvh.Leaves());
+        }
+        return job.MakeCamera();
+    };
+
+    // A worker started by a coordinator only renders the tiles it is given
+    if (options.workerFd >= 0) {
+        return RunWorker(options.workerFd, renderer, bvh, [&](int j) { return prepareJob(j, true); }, options.crashWorkerAfter);
+    }
+    std::unique_ptr<TileCoordinator> coordinator;
+    if (options.workers > 0) {
+        coordinator.reset(new TileCoordinator());
+        if (!coordinator->Start(options.workers, argv[0], options.workerArguments, options.crashWorkerAfter)) {
+            std::cerr << "No worker started, rendering locally.\n";
+            coordinator.reset();
         }
     }
 
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const RenderJob& job = jobs[j];
+        Camera cam = prepareJob(j, false);
+        int width = job.settings.imageWidth;
+        int height = job.settings.imageHeight;
+
+        Framebuffer framebuffer(width, height);
+
+        // The image is written band by band as rows of tiles complete, the format follows the extension (.ppm, .pfm, .png)
+        ImageFile output(job.outputPath, width, height);
+        // Denoised frames are only written once filtered
+        std::function<void(int, int)> streamRows;
+        if (!job.progressive && !job.denoise) {
+            streamRows = [&](int y0, int y1) { output.WriteRows(framebuffer, y0, y1); };
+        }
+        renderer.OnRowsCompleted(coordinator ? nullptr : streamRows);
+
+        std::cerr << "Frame " << j + 1 << "/" << jobs.size() << ": " << job.outputPath << ", " << width << "x" << height << ", "
+                  << job.settings.samplesPerPixel << " spp, " << renderer.ThreadCount() << " threads\n";
+
+        PathCounters counters;
+        ResetProfile();
+        auto renderStart = chrono::steady_clock::now();
+        std::vector<TileStats> tileStats = job.progressive ? RenderProgressive(renderer, bvh, cam, framebuffer, job.passes, &counters)
+                                         : coordinator ? coordinator->Render(static_cast<int>(j), renderer, bvh, cam, framebuffer, streamRows)
+                                         : renderer.Render(bvh, cam, framebuffer);
+        auto renderEnd = chrono::steady_clock::now();
+        renderer.OnRowsCompleted(nullptr);
+        if (!job.progressive) {
+            counters = coordinator ? coordinator->LastPathCounters() : renderer.LastPathCounters();
+        }
+
+        if (job.denoise || !job.aovPrefix.empty()) {
+            auto denoiseStart = chrono::steady_clock::now();
+            AovBuffers aovs(width, height);
+            renderer.RenderAovs(bvh, cam, aovs);
+            if (!job.aovPrefix.empty()) {
+                size_t dot = job.outputPath.find_last_of('.');
+                WriteAovImages(job.aovPrefix, dot == std::string::npos ? ".ppm" : job.outputPath.substr(dot), aovs);
+            }
+            if (job.denoise) {
+                Framebuffer denoised(width, height);
+                Denoise(framebuffer, aovs, job.denoiseSettings, renderer.Pool(), denoised);
+                output.WriteRows(denoised, 0, height);
+                std::cerr << "\rAOVs and denoising: " << chrono::duration<double>(chrono::steady_clock::now() - denoiseStart).count() << " s\n";
+            }
+        }
+        if (job.progressive && !job.denoise) {
+            output.WriteRows(framebuffer, 0, height);
+        }
+        output.Close();
+
+        if (job.settings.adaptive && !job.heatmapPath.empty()) {
+            std::ofstream heatmap(job.heatmapPath);
+            WriteSampleHeatmap(heatmap, framebuffer, renderer.MaxAdaptiveSamples());
+        }
+        if (!job.tileCostPath.empty()) {
+            std::ofstream tileCost(job.tileCostPath);
+            WriteTileCostImage(tileCost, tileStats, width, height);
+        }
+
+        double seconds = chrono::duration<double>(renderEnd - renderStart).count();
+        batch.Add(seconds, counters);
+        std::cerr << "\nRender time: " << seconds << " s, " << counters.segments / seconds / 1e6 << " Mrays/s\n";
+
+        if (reports) {
+            PrintFlatBvhReport(std::cerr, bvh);
+            PrintLightReport(std::cerr, lights);
+
+            // Primary hits only, one sample per pixel on one thread
+            std::cerr << "Primary rays: " << renderer.PrimaryRayRate(bvh, cam, false) / 1e6 << " Mrays/s single, "
+                      << renderer.PrimaryRayRate(bvh, cam, true) / 1e6 << " Mrays/s packets\n";
+            PrintTileReport(std::cerr, tileStats);
+            PrintPathReport(std::cerr, counters);
+            if (job.settings.integrator == IntegratorMode::Wavefront) {
+                PrintWavefrontReport(std::cerr, renderer.LastWavefrontStats());
+            }
+            PrintAdaptiveReport(std::cerr, coordinator && !job.progressive ? coordinator->LastAdaptiveStats() : renderer.LastAdaptiveStats());
+            if (coordinator) {
+                coordinator->PrintReport(std::cerr);
+            }
+            PrintProfileReport(std::cerr);
+        }
+    }
+
+    PrintBatchSummary(std::cerr, batch, setupSeconds);
+    if (animatedBvh) {
+        std::cerr << "Animation setup: " << frameSetupMilliseconds / jobs.size() << " ms per frame refitting, against "
+                  << fullRebuildMilliseconds << " ms for a full BVH rebuild (" << setupSeconds * 1e3 << " ms for the first scene setup)\n";
+    }
+
+    if (options.benchmarkHandles) {
+        // Cost of shared_ptr material handles in hits, measured on the big scene
+        Scene benchmarkScene = RandomScene();
+        PrintHandleBenchmark(std::cerr, RunHandleBenchmark(benchmarkScene.World(), lookFrom, 1 << 16, renderer.ThreadCount()));
+    }
+    if (options.benchmarkImageWrites) {
+        RunImageWriteBenchmark(std::cerr);
+    }
+    if (options.benchmarkSceneLoad) {
+        RunSceneLoadBenchmark(std::cerr);
+    }
+    if (options.benchmarkDenoise) {
+        // Last job's frame and camera, at its sample count for the reference
+        const RenderJob& job = jobs.back();
+        renderer.SetSettings(job.settings);
+        RunDenoiseBenchmark(std::cerr, renderer, bvh, job.MakeCamera(), job.denoiseSettings);
+    }
+    if (options.benchmarkInstances) {
+        renderer.SetSettings(jobs.back().settings);
+        RunInstanceBenchmark(std::cerr, renderer);
+    }
+    if (options.benchmarkLights) {
+        renderer.SetSettings(jobs.back().settings);
+        RunLightBenchmark(std::cerr, renderer);
+    }
+
     std::cerr << "\nDone.\n";
     // =====================================================
 
-    output.close();
-
     return 0;
-}
\ No newline at end of file
+}